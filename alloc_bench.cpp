@@ -0,0 +1,358 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <vector>
+
+#include "asio.hpp"
+
+#include "client_block.hpp"
+#include "loopback_transport.hpp"
+#include "packet_auth.hpp"
+
+#ifdef CBP_COROUTINE_ENGINE
+#include "coro_block.hpp"
+#endif
+
+// Counts heap allocations (replaced operator new) over N receive/send cycles
+// (default 1M) of two peers echoing a packet through loopback_transport, bare
+// and wrapped into auth_transport. Handlers capture only 'this', as blocks'
+// ones do. Then a master with slaves runs steady get_data cycles on virtual
+// time (as in fleet_sim), with default options and with the ones keeping
+// per slave state (--per-slave, --early-cycle, --shards, --sample, --auth),
+// logging into a null stream. The first cycles (seconds) warm up caches
+// (asio recycling allocator, send slots, per session vectors, deferred
+// packets), after them steady traffic must not allocate, otherwise it fails.
+
+namespace
+{
+  size_t allocations = 0;
+  size_t allocated_bytes = 0;
+
+  void *
+  counted_alloc(std::size_t size)
+  {
+    ++allocations;
+    allocated_bytes += size;
+
+    if (void *p = std::malloc(size ? size : 1))
+    {
+      return p;
+    }
+    throw std::bad_alloc();
+  }
+} // namespace
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+  struct result
+  {
+    size_t allocations;
+    size_t bytes;
+    double ns_per_op;
+  };
+
+  // Blocks log every packet: formatting runs, output goes nowhere
+  class null_buf : public std::streambuf
+  {
+  protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+  };
+
+  // Receives a packet and sends it back to its sender, the other peer does
+  // the same, so every cycle is one send and one receive of each side
+  class echo_peer
+  {
+  public:
+    echo_peer(std::unique_ptr<cbp::transport> t, size_t &echoes, size_t last_echo)
+        : transport_(std::move(t)), echoes_(echoes), last_echo_(last_echo)
+    {
+    }
+
+    void
+    receive()
+    {
+      transport_->async_receive_from(asio::buffer(buf_), sender_,
+                                     [this](const asio::error_code &error, size_t n)
+                                     {
+                                       if (!error)
+                                       {
+                                         echo(n);
+                                       }
+                                     });
+    }
+
+    void
+    send(const cbp::transport::endpoint &to, size_t n)
+    {
+      transport_->async_send_to(asio::buffer(buf_, n), to,
+                                [this](const asio::error_code &, size_t) {});
+    }
+
+  private:
+    void
+    echo(size_t n)
+    {
+      if (++echoes_ <= last_echo_)
+      {
+        send(sender_, n);
+        receive();
+      }
+    }
+
+    std::unique_ptr<cbp::transport> transport_;
+    size_t &echoes_;
+    size_t last_echo_;
+
+    cbp::transport::endpoint sender_;
+    uint8_t buf_[cbp::max_datagram_len] = {};
+  };
+
+  result
+  run(size_t warmup, size_t n, bool auth)
+  {
+    asio::io_context io_context;
+    cbp::loopback_network network(io_context);
+
+    auto make = [&]
+    {
+      auto t = std::make_unique<cbp::loopback_transport>(network);
+      const auto local = t->local_endpoint();
+      std::unique_ptr<cbp::transport> r = std::move(t);
+      if (auth)
+      {
+        r = std::make_unique<cbp::auth_transport>(std::move(r), cbp::packet_auth::key_type{1, 2, 3});
+      }
+      return std::make_pair(std::move(r), local);
+    };
+
+    // Both ends count echoes, a cycle is two of them
+    size_t echoes = 0;
+    const size_t last_echo = 2 * (warmup + n);
+    auto [ta, a_local] = make();
+    auto [tb, b_local] = make();
+    echo_peer a(std::move(ta), echoes, last_echo);
+    echo_peer b(std::move(tb), echoes, last_echo);
+
+    a.receive();
+    b.receive();
+    a.send(b_local, cbp::max_packet_len);
+
+    // Warm up
+    while (echoes < 2 * warmup && io_context.run_one())
+    {
+    }
+
+    const size_t allocations_start = allocations;
+    const size_t bytes_start = allocated_bytes;
+    const auto start = clock_type::now();
+
+    while (echoes < last_echo && io_context.run_one())
+    {
+    }
+
+    const double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    return {allocations - allocations_start, allocated_bytes - bytes_start, ns / double(n)};
+  }
+
+  // Everything due until end, timer by timer (virtual time)
+  void
+  run_until(asio::io_context &io_context, cbp::block_clock::time_point end)
+  {
+    auto &wheel = asio::use_service<cbp::timer_wheel>(io_context);
+    for (;;)
+    {
+      io_context.restart();
+      io_context.poll();
+
+      cbp::block_clock::time_point next;
+      if (!wheel.next_tick(next) || next > end)
+      {
+        break;
+      }
+
+      cbp::block_clock::advance_to(next);
+      wheel.run_tick();
+    }
+  }
+
+  struct fleet_result : result
+  {
+    size_t packets;    // delivered, 0 unless the master polled every slave
+    uint64_t deferred; // by master's overload protection
+  };
+
+  // Control block and slaves over loopback, counted over seconds after
+  // warmup seconds; ns_per_op is per delivered packet
+  fleet_result
+  run_fleet(unsigned slaves, long warmup, long seconds, cbp::block_options options)
+  {
+    cbp::block_clock::start_virtual();
+
+    asio::io_context io_context;
+    cbp::loopback_network network(io_context);
+    const auto multicast_address = asio::ip::make_address("239.255.0.1");
+
+    std::vector<std::unique_ptr<cbp::control_block>> blocks;
+    for (unsigned i = 0; i <= slaves; ++i)
+    {
+      options.id_seed = i + 1;
+      auto t = std::make_unique<cbp::loopback_transport>(network);
+
+#ifdef CBP_COROUTINE_ENGINE
+      if (options.coro_engine)
+      {
+        blocks.push_back(std::make_unique<cbp::coro_block>(io_context, std::move(t), multicast_address, options,
+                                                           i == 0));
+        continue;
+      }
+#endif
+
+      if (i == 0)
+      {
+        blocks.push_back(std::make_unique<cbp::control_block>(io_context, std::move(t), multicast_address, options));
+      }
+      else
+      {
+        blocks.push_back(std::make_unique<cbp::client_block>(io_context, std::move(t), multicast_address, options));
+      }
+    }
+
+    for (auto &b : blocks)
+    {
+      b->start();
+    }
+
+    run_until(io_context, cbp::block_clock::now() + std::chrono::seconds(warmup));
+
+    const size_t allocations_start = allocations;
+    const size_t bytes_start = allocated_bytes;
+    const uint64_t delivered_start = network.delivered();
+    const uint64_t deferred_start = blocks.front()->overload().deferred;
+    const auto start = clock_type::now();
+
+    run_until(io_context, cbp::block_clock::now() + std::chrono::seconds(seconds));
+
+    const double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    const cbp::control_block &master = *blocks.front();
+
+    fleet_result r;
+    r.allocations = allocations - allocations_start;
+    r.bytes = allocated_bytes - bytes_start;
+    r.packets = network.delivered() - delivered_start;
+    r.deferred = master.overload().deferred - deferred_start;
+    r.ns_per_op = r.packets ? ns / double(r.packets) : 0;
+
+    if (!master.is_master() || master.fleet() < 0.9 * double(slaves))
+    {
+      r.packets = 0;
+    }
+    return r;
+  }
+
+  void
+  print(const char *name, const char *op, size_t n, const result &r)
+  {
+    std::cout << name
+              << ": allocations=" << r.allocations
+              << " (" << double(r.allocations) / double(n) << " per " << op << ")"
+              << ", bytes=" << r.bytes
+              << ", " << op << "=" << r.ns_per_op << "ns"
+              << std::endl;
+  }
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 2)
+  {
+    std::cerr << "Usage: alloc_bench [cycles]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    alloc_bench 1000000\n";
+    return 1;
+  }
+
+  const size_t n = (argc == 2) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const size_t warmup = 1000;
+
+  std::cout << "cycles=" << n << ", warmup=" << warmup << std::endl;
+  const result plain = run(warmup, n, false);
+  print("loopback     ", "cycle", n, plain);
+  const result auth = run(warmup, n, true);
+  print("loopback+auth", "cycle", n, auth);
+
+  if (plain.allocations || auth.allocations)
+  {
+    std::cerr << "Steady receive/send allocated " << plain.allocations + auth.allocations << " times" << std::endl;
+    return 1;
+  }
+
+  // Master with slaves: first get_data cycle is 5s, then 200..500ms ones
+  cbp::block_options options;
+  options.cycle_min = std::chrono::milliseconds(200);
+  options.cycle_max = std::chrono::milliseconds(500);
+
+  cbp::block_options loaded = options;
+  loaded.per_slave = true;
+  loaded.early_cycle = 1;
+  loaded.shards = 2;
+  loaded.sample_rate = 20;
+  loaded.auth = true;
+  loaded.auth_key = {1, 2, 3};
+
+  struct fleet_run
+  {
+    const char *name;
+    cbp::block_options options;
+  };
+  std::vector<fleet_run> runs = {{"fleet        ", options}, {"fleet+options", loaded}};
+#ifdef CBP_COROUTINE_ENGINE
+  options.coro_engine = loaded.coro_engine = true;
+  runs.push_back({"coro         ", options});
+  runs.push_back({"coro+options ", loaded});
+#endif
+
+  // Enough slaves for master's inbox to back up: answers are put aside too
+  const unsigned slaves = 200;
+  const long fleet_warmup = 20;
+  const long seconds = 60;
+
+  std::cout << "slaves=" << slaves << ", seconds=" << seconds << ", warmup=" << fleet_warmup << std::endl;
+  for (const auto &f : runs)
+  {
+    null_buf null;
+    auto *out = std::cout.rdbuf(&null);
+    const fleet_result r = run_fleet(slaves, fleet_warmup, seconds, f.options);
+    std::cout.rdbuf(out);
+
+    print(f.name, "packet", r.packets, r);
+    std::cout << "  packets=" << r.packets << ", deferred=" << r.deferred << std::endl;
+
+    if (!r.packets)
+    {
+      std::cerr << f.name << ": master did not poll every slave" << std::endl;
+      return 1;
+    }
+
+    if (r.allocations)
+    {
+      std::cerr << f.name << ": steady get_data cycles allocated " << r.allocations << " times" << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
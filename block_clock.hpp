@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace cbp
+{
+  // Clock of protocol timing (timers, get_data cycles, rate limits):
+  // steady_clock, or virtual time of a simulation (fleet_sim). Virtual time
+  // stands still while handlers run and is moved by the simulation from one
+  // timer_wheel tick to the next, so a run does not depend on CPU speed and
+  // takes only the CPU time its packets need. It starts at the steady_clock
+  // reading, time points of both are interchangeable.
+  // Virtual time belongs to the thread that started it (the one running the
+  // blocks): its state is thread_local, so renderer, status and other threads
+  // keep reading steady_clock and never race with advance_to().
+  class block_clock
+  {
+  public:
+    using duration = std::chrono::steady_clock::duration;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::steady_clock::time_point;
+    static constexpr bool is_steady = true;
+
+    static time_point
+    now()
+    {
+      return virtual_ ? virtual_now_ : std::chrono::steady_clock::now();
+    }
+
+    static bool is_virtual() { return virtual_; }
+
+    // Before any block is created
+    static void
+    start_virtual()
+    {
+      virtual_now_ = std::chrono::steady_clock::now();
+      virtual_ = true;
+    }
+
+    // Never backwards
+    static void advance_to(time_point tp) { virtual_now_ = std::max(virtual_now_, tp); }
+
+  private:
+    static inline thread_local bool virtual_ = {false};
+    static inline thread_local time_point virtual_now_;
+  };
+
+} // namespace cbp
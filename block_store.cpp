@@ -0,0 +1,190 @@
+#include "block_store.hpp"
+
+namespace cbp
+{
+  block_store::block_store(size_t reserve, bool sampling)
+      : origin_(clock::now()),
+        sampling_(sampling),
+        gen_(std::random_device()()),
+        random_temperature_(-45, 45),
+        random_brightness_(350, 550)
+  {
+    state_.reserve(reserve);
+    master_mode_.reserve(reserve);
+    deadline_.reserve(reserve);
+    master_key_.reserve(reserve);
+    session_.reserve(reserve);
+    sensors_.reserve(reserve);
+    ids_.reserve(reserve);
+    master_id_.reserve(reserve);
+    displayed_.reserve(reserve);
+
+    if (sampling_)
+    {
+      samples_.reserve(reserve);
+      summaries_.reserve(reserve);
+    }
+  }
+
+  size_t
+  block_store::add(const boost::uuids::uuid &id)
+  {
+    state_.push_back(block_state::waiting_for_master);
+    master_mode_.push_back(packet_header::block_mode::master);
+    deadline_.push_back(0);
+    master_key_.push_back(0);
+    session_.push_back(session_grant());
+    sensors_.push_back(sensor_data());
+    ids_.push_back(id);
+    master_id_.push_back(boost::uuids::nil_uuid());
+    displayed_.push_back(display_data());
+
+    if (sampling_)
+    {
+      samples_.push_back(sensor_summary());
+      summaries_.push_back(sensor_summary());
+    }
+
+    return ids_.size() - 1;
+  }
+
+  // Same as client_block::follow_master, without printing
+  void
+  block_store::follow(size_t i, const boost::uuids::uuid &master, packet_header::block_mode mode, uint32_t now)
+  {
+    state_[i] = block_state::slave;
+    master_id_[i] = master;
+    master_key_[i] = packet_header::key_of(master);
+    master_mode_[i] = mode;
+    session_[i] = session_grant();
+    deadline_[i] = now + uint32_t(tmout_no_request_from_master.count());
+  }
+
+  void
+  block_store::read_sensors_data(size_t i)
+  {
+    sensors_[i].temperature = random_temperature_(gen_);
+    sensors_[i].brightness = random_brightness_(gen_);
+  }
+
+  void
+  block_store::sample()
+  {
+    for (size_t i = 0, n = samples_.size(); i < n; ++i)
+    {
+      read_sensors_data(i);
+      samples_[i].add(sensors_[i]);
+    }
+  }
+
+  // Same as client_block::get_data_response: sensors are read now, or with
+  // sampling summarized since previous request
+  void
+  block_store::get_data_response(size_t i)
+  {
+    if (!sampling_)
+    {
+      read_sensors_data(i);
+      return;
+    }
+
+    if (!samples_[i].count)
+    {
+      read_sensors_data(i);
+      samples_[i].add(sensors_[i]);
+    }
+
+    summaries_[i] = samples_[i];
+    samples_[i] = sensor_summary();
+  }
+
+  size_t
+  block_store::reply_to_netbuf(size_t i, packet_header::packet_type pt, uint8_t *net_buf) const
+  {
+    if (pt != packet_header::packet_type::get_data_rsp)
+    {
+      packet_header::to_netbuf(net_buf, pt, packet_header::block_mode::slave, ids_[i]);
+      return sizeof(packet_header);
+    }
+
+    // Header as client_block::response_header
+    size_t len = sizeof(packet_header);
+    if (session_[i].session)
+    {
+      session_header::to_netbuf(net_buf, pt, packet_header::block_mode::slave,
+                                session_[i].session, session_[i].epoch);
+      len = sizeof(session_header);
+    }
+    else
+    {
+      packet_header::to_netbuf(net_buf, pt, packet_header::block_mode::slave, ids_[i]);
+    }
+
+    uint8_t *payload = net_buf + len;
+    sensor_data sd = sensors_[i];
+    sd.to_payload(payload);
+    len += sizeof(sensor_data);
+
+    if (sampling_)
+    {
+      summaries_[i].to_payload(payload);
+      len += sizeof(sensor_summary);
+    }
+
+    return len;
+  }
+
+  size_t
+  block_store::expire(clock::time_point now)
+  {
+    const uint32_t now_ms = ms_since_origin(now);
+    size_t expired = 0;
+
+    for (size_t i = 0, n = size(); i < n; ++i)
+    {
+      if (state_[i] == block_state::slave && int32_t(now_ms - deadline_[i]) >= 0)
+      {
+        state_[i] = block_state::waiting_for_master;
+        master_id_[i] = boost::uuids::nil_uuid();
+        master_key_[i] = 0;
+        ++expired;
+      }
+    }
+
+    return expired;
+  }
+
+  block_store::memory_usage
+  block_store::memory_per_block() const
+  {
+    const size_t n = std::max(size(), size_t(1));
+
+    memory_usage m;
+    m.hot = (state_.capacity() * sizeof(block_state) +
+             master_mode_.capacity() * sizeof(packet_header::block_mode) +
+             deadline_.capacity() * sizeof(uint32_t) +
+             master_key_.capacity() * sizeof(uint64_t) +
+             session_.capacity() * sizeof(session_grant) +
+             sensors_.capacity() * sizeof(sensor_data)) /
+            n;
+    m.cold = (ids_.capacity() * sizeof(boost::uuids::uuid) +
+              master_id_.capacity() * sizeof(boost::uuids::uuid) +
+              displayed_.capacity() * sizeof(display_data) +
+              (samples_.capacity() + summaries_.capacity()) * sizeof(sensor_summary)) /
+             n;
+    return m;
+  }
+
+  void
+  block_store::print_memory(std::ostream &os) const
+  {
+    const memory_usage m = memory_per_block();
+
+    os << "block_store: blocks=" << size()
+       << ", hot=" << m.hot << " B/block"
+       << ", cold=" << m.cold << " B/block"
+       << ", total=" << (m.hot + m.cold) * size() / 1024 << " KiB"
+       << std::endl;
+  }
+
+} // namespace cbp
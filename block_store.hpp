@@ -0,0 +1,257 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "boost/uuid/uuid.hpp"
+#include "boost/uuid/nil_generator.hpp"
+
+#include "cbp_base.hpp"
+#include "display_batch.hpp"
+
+namespace cbp
+{
+  // Struct-of-arrays state of N simulated indication blocks for dense simulation.
+  // Fields touched on every packet live in separate contiguous arrays, so a
+  // get_data_req sweep over 100k blocks reads ~22 bytes per block instead of a
+  // client_block object (dispatcher_, buffers, random_device, transport).
+  // Cold data (own and master ids, last displayed set_data, --sample
+  // summaries) is kept apart.
+  // There is no per-block dispatcher, timer or buffer: a multicast packet is
+  // applied to all blocks in one pass, a unicast one to its block only, and
+  // replies are produced by the sink.
+  // Blocks only take slave role (waiting_for_master/slave), master is a real
+  // control_block or the simulation driver, so master_needed_req is ignored.
+  // Slave rules are those of client_block: master is told by leading 64 bits
+  // of its id, get_data_req answered only for own shard (poll_selector::polls),
+  // get_data_rsp goes with session_header once master gave a session
+  // (session_assign, revoked one is answered again with packet_header),
+  // set_data_batch is looked up by session and, with sampling, get_data_rsp
+  // carries sensor_summary of readings since previous request.
+  class block_store
+  {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    enum class block_state : uint8_t
+    {
+      waiting_for_master,
+      slave
+    };
+
+    struct memory_usage
+    {
+      size_t hot;
+      size_t cold;
+    };
+
+    // Constants
+    static constexpr std::chrono::milliseconds tmout_no_request_from_master = std::chrono::seconds(30);
+
+    // sampling - blocks take readings on sample() (--sample of client_block)
+    explicit block_store(size_t reserve = 0, bool sampling = false);
+
+    size_t add(const boost::uuids::uuid &id);
+    size_t size() const { return ids_.size(); }
+
+    // Apply packet received from the network (or driver) to every block, or
+    // (unicast) to block i only.
+    // sink(index, packet_type) is called for each reply a block would send,
+    // reply_to_netbuf() serializes it.
+    template <typename Sink>
+    void handle_packet(uint8_t *net_buf, size_t len, clock::time_point now, Sink &&sink)
+    {
+      apply_packet(0, size(), net_buf, len, now, sink);
+    }
+
+    template <typename Sink>
+    void handle_packet(size_t i, uint8_t *net_buf, size_t len, clock::time_point now, Sink &&sink)
+    {
+      apply_packet(i, i + 1, net_buf, len, now, sink);
+    }
+
+    size_t reply_to_netbuf(size_t i, packet_header::packet_type pt, uint8_t *net_buf) const;
+
+    // One reading of every block into its summary (sampling only)
+    void sample();
+
+    // Slaves without get_data_req within tmout_no_request_from_master go back
+    // to waiting_for_master. Returns number of such blocks.
+    size_t expire(clock::time_point now);
+
+    block_state state(size_t i) const { return state_[i]; }
+    const boost::uuids::uuid &id(size_t i) const { return ids_[i]; }
+    const sensor_data &sensors(size_t i) const { return sensors_[i]; }
+    const display_data &displayed(size_t i) const { return displayed_[i]; }
+    uint16_t session(size_t i) const { return session_[i].session; }
+
+    // Bytes per block of hot and cold arrays (by capacity)
+    memory_usage memory_per_block() const;
+    void print_memory(std::ostream &os) const;
+
+  private:
+    uint32_t ms_since_origin(clock::time_point tp) const
+    {
+      return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(tp - origin_).count());
+    }
+
+    template <typename Sink>
+    void apply_packet(size_t first, size_t last, uint8_t *net_buf, size_t len, clock::time_point now, Sink &&sink);
+
+    bool from_master(size_t i, uint64_t key) const
+    {
+      return state_[i] == block_state::slave && master_key_[i] == key;
+    }
+
+    void follow(size_t i, const boost::uuids::uuid &master, packet_header::block_mode mode, uint32_t now);
+    void read_sensors_data(size_t i);
+    void get_data_response(size_t i);
+
+    clock::time_point origin_;
+
+    // Hot arrays, indexed by block
+    std::vector<block_state> state_;
+    std::vector<packet_header::block_mode> master_mode_;
+    std::vector<uint32_t> deadline_; // ms since origin_, wraps after 49 days
+    std::vector<uint64_t> master_key_;
+    std::vector<session_grant> session_;
+    std::vector<sensor_data> sensors_;
+
+    // Cold arrays
+    std::vector<boost::uuids::uuid> ids_;
+    std::vector<boost::uuids::uuid> master_id_;
+    std::vector<display_data> displayed_;
+
+    // Sampling: readings since previous get_data_req and summary sent in
+    // reply to it, empty without sampling
+    std::vector<sensor_summary> samples_;
+    std::vector<sensor_summary> summaries_;
+    bool sampling_;
+
+    // One sensors randomizer for the whole store
+    std::minstd_rand gen_;
+    std::uniform_int_distribution<int16_t> random_temperature_;
+    std::uniform_int_distribution<uint16_t> random_brightness_;
+  };
+
+  template <typename Sink>
+  void
+  block_store::apply_packet(size_t first, size_t last, uint8_t *net_buf, size_t len, clock::time_point now, Sink &&sink)
+  {
+    if (!packet_header::is_packet_valid(net_buf, len))
+    {
+      return;
+    }
+
+    const boost::uuids::uuid &id = packet_header::id_from_netbuf(net_buf);
+    const uint64_t key = packet_header::key_from_netbuf(net_buf);
+    const packet_header::block_mode mode = packet_header::mode_from_netbuf(net_buf);
+    const uint32_t now_ms = ms_since_origin(now);
+
+    switch (packet_header::op_from_netbuf(net_buf))
+    {
+    case packet_header::packet_type::i_am_master_rsp:
+      for (size_t i = first; i < last; ++i)
+      {
+        if (state_[i] == block_state::waiting_for_master)
+        {
+          follow(i, id, mode, now_ms);
+        }
+      }
+      break;
+
+    case packet_header::packet_type::slave_needed_req:
+      // Any master while waiting; temp master may be replaced by CB or by
+      // temp master with greater block_id
+      for (size_t i = first; i < last; ++i)
+      {
+        if (state_[i] == block_state::waiting_for_master ||
+            (master_mode_[i] == packet_header::block_mode::tmp_master &&
+             (mode == packet_header::block_mode::master || id > master_id_[i])))
+        {
+          follow(i, id, mode, now_ms);
+          sink(i, packet_header::packet_type::i_am_slave_rsp);
+        }
+      }
+      break;
+
+    case packet_header::packet_type::get_data_req:
+      // Request for another shard shows master is alive as well
+      for (size_t i = first; i < last; ++i)
+      {
+        if (from_master(i, key))
+        {
+          deadline_[i] = now_ms + uint32_t(tmout_no_request_from_master.count());
+
+          if (poll_selector::polls(net_buf, len, ids_[i]))
+          {
+            get_data_response(i);
+            sink(i, packet_header::packet_type::get_data_rsp);
+          }
+        }
+      }
+      break;
+
+    case packet_header::packet_type::set_data:
+    {
+      const display_data &data = display_data::from_netbuf(net_buf);
+      for (size_t i = first; i < last; ++i)
+      {
+        if (from_master(i, key))
+        {
+          displayed_[i] = data;
+        }
+      }
+      break;
+    }
+
+    case packet_header::packet_type::set_data_batch:
+    {
+      display_data shared;
+      display_batch::shared_from_netbuf(net_buf, shared);
+
+      display_record r;
+      for (size_t i = first; i < last; ++i)
+      {
+        if (session_[i].session && from_master(i, key) &&
+            display_batch::find(net_buf, session_[i].session, r))
+        {
+          displayed_[i] = shared;
+          displayed_[i].brightness = htons(r.brightness);
+        }
+      }
+      break;
+    }
+
+    case packet_header::packet_type::session_assign:
+    {
+      session_grant g;
+      g.from_netbuf(net_buf);
+
+      for (size_t i = first; i < last; ++i)
+      {
+        if (from_master(i, key))
+        {
+          // Master (restarted) dropped the answer with unknown session
+          const bool revoked = session_[i].session && !g.session;
+
+          session_[i] = g;
+          if (revoked)
+          {
+            get_data_response(i);
+            sink(i, packet_header::packet_type::get_data_rsp);
+          }
+        }
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+} // namespace cbp
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "busy_poll.hpp"
+
+namespace cbp
+{
+  // Constants
+  static constexpr int max_backoff_ms = 4;
+
+  void
+  pin_to_cpu(int cpu)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (int r = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set))
+    {
+      throw asio::system_error(asio::error_code(r, asio::error::get_system_category()), "pin to cpu");
+    }
+  }
+
+  void
+  run_busy_poll(asio::io_context &io_context, const std::vector<int> &fds,
+                std::chrono::microseconds spin)
+  {
+    std::vector<pollfd> pfds;
+    for (int fd : fds)
+    {
+      pfds.push_back(pollfd{fd, POLLIN, 0});
+    }
+
+    auto work = asio::make_work_guard(io_context);
+    auto idle_since = std::chrono::steady_clock::now();
+    int backoff_ms = 0;
+
+    while (!io_context.stopped())
+    {
+      if (io_context.poll())
+      {
+        idle_since = std::chrono::steady_clock::now();
+        backoff_ms = 0;
+        continue;
+      }
+
+      if (std::chrono::steady_clock::now() - idle_since < spin)
+      {
+        continue;
+      }
+
+      backoff_ms = std::min(std::max(backoff_ms * 2, 1), max_backoff_ms);
+
+      if (::poll(pfds.data(), pfds.size(), backoff_ms) > 0)
+      {
+        idle_since = std::chrono::steady_clock::now();
+        backoff_ms = 0;
+      }
+    }
+  }
+
+  void
+  latency_histogram::print(std::ostream &os)
+  {
+    if (!total_)
+    {
+      return;
+    }
+
+    static const double percentiles[] = {50, 90, 99, 99.9};
+
+    os << "Latency (us):";
+
+    uint64_t seen = 0;
+    int b = 0;
+    for (double p : percentiles)
+    {
+      const uint64_t rank = uint64_t(p / 100 * double(total_ - 1)) + 1;
+      for (; b < buckets && seen + counts_[b] < rank; ++b)
+      {
+        seen += counts_[b];
+      }
+
+      os << " p" << p << "=";
+      if (b < buckets)
+      {
+        os << b;
+      }
+      else
+      {
+        os << ">" << buckets;
+      }
+    }
+
+    os << " max=" << std::chrono::duration_cast<std::chrono::microseconds>(max_).count()
+       << " samples=" << total_
+       << std::endl;
+
+    std::memset(counts_, 0, sizeof(counts_));
+    total_ = 0;
+    max_ = duration::zero();
+  }
+
+} // namespace cbp
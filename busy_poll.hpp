@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "asio.hpp"
+
+namespace cbp
+{
+  // Low latency master loop (--busy-poll=<cpu>[:<spin_us>]).
+  // Instead of sleeping in io_context.run(), the pinned thread keeps calling
+  // io_context.poll(). After spin without any handler it backs off into
+  // poll() on transport descriptors with a growing timeout (1..max_backoff ms,
+  // so timers are still served), any readable descriptor resets the backoff.
+  void pin_to_cpu(int cpu);
+  void run_busy_poll(asio::io_context &io_context, const std::vector<int> &fds,
+                     std::chrono::microseconds spin);
+
+  // Wake-to-handle latency: kernel receive stamp of a datagram to the start of
+  // its handler (--latency). 1us buckets up to 10ms plus overflow.
+  class latency_histogram
+  {
+  public:
+    using duration = std::chrono::nanoseconds;
+
+    // Constants
+    static constexpr int buckets = 10000;
+
+    void record(duration d)
+    {
+      const int64_t us = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+      ++counts_[std::min<int64_t>(us, buckets)];
+      ++total_;
+      max_ = std::max(max_, d);
+    }
+
+    // p50/p90/p99/p99.9/max of samples since previous print, then reset
+    void print(std::ostream &os);
+
+  private:
+    uint32_t counts_[buckets + 1] = {0};
+    uint64_t total_ = {0};
+    duration max_ = {duration::zero()};
+  };
+
+} // namespace cbp
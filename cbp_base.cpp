@@ -25,12 +25,21 @@ namespace cbp
     }
 
     if (op == packet_header::packet_type::get_data_rsp &&
-        packet_size != (sizeof(packet_header) + sizeof(sensor_data)))
+        packet_size != (sizeof(packet_header) + sizeof(sensor_data)) &&
+        packet_size != (sizeof(packet_header) + sizeof(sensor_data) + sizeof(sensor_summary)))
     {
       // wrong size of get_data_rsp packet
       return false;
     }
 
+    if (op == packet_header::packet_type::get_data_req &&
+        packet_size != sizeof(packet_header) &&
+        packet_size != (sizeof(packet_header) + sizeof(poll_selector)))
+    {
+      // wrong size of get_data_req packet
+      return false;
+    }
+
     if (op == packet_header::packet_type::set_data &&
         packet_size != (sizeof(packet_header) + sizeof(display_data)))
     {
@@ -38,6 +47,25 @@ namespace cbp
       return false;
     }
 
+    if (op == packet_header::packet_type::session_assign &&
+        packet_size != (sizeof(packet_header) + sizeof(session_grant)))
+    {
+      // wrong size of session_assign packet
+      return false;
+    }
+
+    if (op == packet_header::packet_type::set_data_batch)
+    {
+      const batch_header *b = reinterpret_cast<const batch_header *>(net_buf + sizeof(packet_header));
+
+      if (packet_size < batch_fixed_len ||
+          packet_size != batch_fixed_len + ntohs(b->count) * sizeof(display_record))
+      {
+        // wrong size of set_data_batch packet
+        return false;
+      }
+    }
+
     if (packet_header::mode_from_netbuf(net_buf) > block_mode::tmp_master)
     {
       // wrong mode
@@ -46,4 +74,26 @@ namespace cbp
 
     return true;
   }
+
+  bool
+  session_header::is_packet_valid(const uint8_t *net_buf, size_t packet_size)
+  {
+    const session_header h = from_netbuf(net_buf);
+
+    if (h.operation != to_idx(packet_header::packet_type::get_data_rsp) ||
+        h.mode > to_idx(packet_header::block_mode::tmp_master))
+    {
+      // wrong op or mode
+      return false;
+    }
+
+    if (packet_size != (sizeof(session_header) + sizeof(sensor_data)) &&
+        packet_size != (sizeof(session_header) + sizeof(sensor_data) + sizeof(sensor_summary)))
+    {
+      // wrong size of get_data_rsp packet
+      return false;
+    }
+
+    return true;
+  }
 } // namespace cbp
\ No newline at end of file
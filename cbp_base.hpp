@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstddef>
 #include <cstring>
 #include <netinet/in.h>
 
@@ -31,6 +32,8 @@ namespace cbp
       get_data_req,
       get_data_rsp,
       set_data,
+      set_data_batch,
+      session_assign,
       number
     };
 
@@ -41,11 +44,27 @@ namespace cbp
       tmp_master
     };
 
+    static const char *
+    mode_name(block_mode m)
+    {
+      static const char *modes[] = {"master", "slave", "tmp_master"};
+      return modes[to_idx(m)];
+    }
+
+    static const char *
+    type_name(packet_type pt)
+    {
+      static const char *types[] = {"master_needed_req", "i_am_master_rsp", "slave_needed_req",
+                                    "i_am_slave_rsp", "get_data_req", "get_data_rsp", "set_data",
+                                    "set_data_batch", "session_assign"};
+      static_assert(std::size(types) == to_idx(packet_type::number), "name of every packet type");
+      return (pt < packet_type::number) ? types[to_idx(pt)] : "unknown";
+    }
+
     static void
     print_mode(block_mode m)
     {
-      static const char *modes[] = {"master", "slave", "tmp_master"};
-      std::cout << modes[to_idx(m)];
+      std::cout << mode_name(m);
     }
 
     static void
@@ -78,6 +97,33 @@ namespace cbp
       return p->block_id;
     }
 
+    // Short id of a slave in set_data_batch records and poll shards. Random
+    // (v4) id, leading bytes are uniform
+    static uint32_t
+    compact_id(const boost::uuids::uuid &id)
+    {
+      return (uint32_t(id.data[0]) << 24) | (uint32_t(id.data[1]) << 16) |
+             (uint32_t(id.data[2]) << 8) | uint32_t(id.data[3]);
+    }
+
+    // Leading 64 bits of block id in net_buf (or of id): random (v4) ids of
+    // one network differ in them, so a known sender is told by one compare
+    static uint64_t
+    key_from_netbuf(const uint8_t *net_buf)
+    {
+      uint64_t key;
+      std::memcpy(&key, net_buf + offsetof(packet_header, block_id), sizeof(key));
+      return key;
+    }
+
+    static uint64_t
+    key_of(const boost::uuids::uuid &id)
+    {
+      uint64_t key;
+      std::memcpy(&key, id.data, sizeof(key));
+      return key;
+    }
+
     static bool
     is_packet_valid(uint8_t *net_buf, size_t packet_size);
   };
@@ -90,22 +136,235 @@ namespace cbp
     void from_netbuf(uint8_t *net_buf)
     {
       // read data right after packet_header
-      sensor_data *d = reinterpret_cast<sensor_data *>(net_buf + sizeof(packet_header));
+      from_payload(net_buf + sizeof(packet_header));
+    }
+
+    void to_netbuf(uint8_t *net_buf)
+    {
+      // wright data right after packet_header
+      to_payload(net_buf + sizeof(packet_header));
+    }
+
+    // Same right after any header (session_header too)
+    void from_payload(const uint8_t *payload)
+    {
+      const sensor_data *d = reinterpret_cast<const sensor_data *>(payload);
 
       temperature = ntohs(d->temperature);
       brightness = ntohs(d->brightness);
     }
 
-    void to_netbuf(uint8_t *net_buf)
+    void to_payload(uint8_t *payload)
     {
-      // wright data right after packet_header
-      sensor_data *d = reinterpret_cast<sensor_data *>(net_buf + sizeof(packet_header));
+      sensor_data *d = reinterpret_cast<sensor_data *>(payload);
 
       d->temperature = htons(temperature);
       d->brightness = htons(brightness);
     }
   };
 
+  // Short header of get_data_rsp from slave which has session id assigned
+  // by its master (session_assign): 8 bytes instead of packet_header's 20,
+  // block id is looked up by master. Told apart by session_flag in operation
+  struct alignas(1) session_header
+  {
+    uint16_t operation;
+    uint16_t mode;
+    uint16_t session;
+    uint16_t epoch;
+
+    // Constants
+    static constexpr uint16_t session_flag = 0x8000;
+
+    static bool
+    is_session(const uint8_t *net_buf, size_t packet_size)
+    {
+      const session_header *p = reinterpret_cast<const session_header *>(net_buf);
+      return packet_size >= sizeof(session_header) && (ntohs(p->operation) & session_flag);
+    }
+
+    static void
+    to_netbuf(uint8_t *net_buf, packet_header::packet_type pt, packet_header::block_mode bt,
+              uint16_t session, uint16_t epoch)
+    {
+      session_header *p = reinterpret_cast<session_header *>(net_buf);
+      p->operation = htons(static_cast<uint16_t>(pt) | session_flag);
+      p->mode = htons(static_cast<uint16_t>(bt));
+      p->session = htons(session);
+      p->epoch = htons(epoch);
+    }
+
+    static session_header
+    from_netbuf(const uint8_t *net_buf)
+    {
+      const session_header *p = reinterpret_cast<const session_header *>(net_buf);
+      return {uint16_t(ntohs(p->operation) & ~session_flag), ntohs(p->mode), ntohs(p->session), ntohs(p->epoch)};
+    }
+    // Only get_data_rsp goes with session_header
+    static bool
+    is_packet_valid(const uint8_t *net_buf, size_t packet_size);
+  };
+
+  static_assert(sizeof(session_header) == 8, "session_header must have no padding");
+
+  // Payload of session_assign (master to slave, unicast): session id to use
+  // in session_header, 0 - back to packet_header
+  struct alignas(1) session_grant
+  {
+    uint16_t session = {0};
+    uint16_t epoch = {0};
+
+    void
+    to_netbuf(uint8_t *net_buf) const
+    {
+      // write data right after packet_header
+      session_grant *d = reinterpret_cast<session_grant *>(net_buf + sizeof(packet_header));
+
+      d->session = htons(session);
+      d->epoch = htons(epoch);
+    }
+
+    void
+    from_netbuf(uint8_t *net_buf)
+    {
+      // read data right after packet_header
+      session_grant *d = reinterpret_cast<session_grant *>(net_buf + sizeof(packet_header));
+
+      session = ntohs(d->session);
+      epoch = ntohs(d->epoch);
+    }
+  };
+
+  // Optional payload of get_data_req (master with --shards): only slaves of
+  // the selected shard answer. Shard of a slave is fixed by its id
+  struct alignas(1) poll_selector
+  {
+    uint16_t shard = {0};
+    uint16_t shards = {1};
+
+    static uint16_t
+    shard_of(const boost::uuids::uuid &id, uint16_t shards)
+    {
+      return (shards > 1) ? packet_header::compact_id(id) % shards : 0;
+    }
+
+    bool selects(const boost::uuids::uuid &id) const { return shard_of(id, shards) == shard; }
+
+    // get_data_req of packet_size bytes is for block with given id: it has
+    // no selector or selects shard of the block
+    static bool
+    polls(uint8_t *net_buf, size_t packet_size, const boost::uuids::uuid &id)
+    {
+      if (packet_size != sizeof(packet_header) + sizeof(poll_selector))
+      {
+        return true;
+      }
+
+      poll_selector selector;
+      selector.from_netbuf(net_buf);
+      return selector.selects(id);
+    }
+
+    void
+    to_netbuf(uint8_t *net_buf) const
+    {
+      // write data right after packet_header
+      poll_selector *d = reinterpret_cast<poll_selector *>(net_buf + sizeof(packet_header));
+
+      d->shard = htons(shard);
+      d->shards = htons(shards);
+    }
+
+    void
+    from_netbuf(uint8_t *net_buf)
+    {
+      // read data right after packet_header
+      poll_selector *d = reinterpret_cast<poll_selector *>(net_buf + sizeof(packet_header));
+
+      shard = ntohs(d->shard);
+      shards = ntohs(d->shards);
+    }
+  };
+
+  // Optional tail of get_data_rsp after sensor_data (slave with --sample):
+  // readings taken since previous get_data_req, sensor_data is the last one
+  struct alignas(1) sensor_summary
+  {
+    int32_t t_sum = {0};
+    uint32_t b_sum = {0};
+    uint16_t count = {0};
+    int16_t t_min = {0};
+    int16_t t_max = {0};
+    uint16_t b_min = {0};
+    uint16_t b_max = {0};
+    uint16_t reserved = {0};
+
+    // Reading taken into summary
+    void
+    add(const sensor_data &d)
+    {
+      if (!count++)
+      {
+        t_min = t_max = d.temperature;
+        b_min = b_max = d.brightness;
+      }
+
+      t_sum += d.temperature;
+      b_sum += d.brightness;
+      t_min = std::min(t_min, d.temperature);
+      t_max = std::max(t_max, d.temperature);
+      b_min = std::min(b_min, d.brightness);
+      b_max = std::max(b_max, d.brightness);
+    }
+
+    void
+    to_netbuf(uint8_t *net_buf) const
+    {
+      // right after sensor_data
+      to_payload(net_buf + sizeof(packet_header));
+    }
+
+    void
+    from_netbuf(const uint8_t *net_buf)
+    {
+      from_payload(net_buf + sizeof(packet_header));
+    }
+
+    // Payload of get_data_rsp after any header, starts with sensor_data
+    void
+    to_payload(uint8_t *payload) const
+    {
+      sensor_summary d;
+      d.t_sum = htonl(t_sum);
+      d.b_sum = htonl(b_sum);
+      d.count = htons(count);
+      d.t_min = htons(t_min);
+      d.t_max = htons(t_max);
+      d.b_min = htons(b_min);
+      d.b_max = htons(b_max);
+
+      // write data right after sensor_data, may be unaligned
+      std::memcpy(payload + sizeof(sensor_data), &d, sizeof(d));
+    }
+
+    void
+    from_payload(const uint8_t *payload)
+    {
+      sensor_summary d;
+      std::memcpy(&d, payload + sizeof(sensor_data), sizeof(d));
+
+      t_sum = ntohl(d.t_sum);
+      b_sum = ntohl(d.b_sum);
+      count = ntohs(d.count);
+      t_min = ntohs(d.t_min);
+      t_max = ntohs(d.t_max);
+      b_min = ntohs(d.b_min);
+      b_max = ntohs(d.b_max);
+    }
+  };
+
+  static_assert(sizeof(sensor_summary) == 20, "sensor_summary must have no padding");
+
   constexpr int display_txt_len = 45; // Text string ended by trailing zero 
   constexpr int temperature_len = 8;  // Format [+/-]TT °C and trailing zero 
   constexpr int display_time_len = 9; // Format HH:MM:SS and trailing zero 
@@ -140,6 +399,80 @@ namespace cbp
     }
   };
 
-  constexpr size_t max_packet_len = sizeof(packet_header) +
-                                    std::max(sizeof(sensor_data), sizeof(display_data));
+  // set_data_batch (master with --per-slave): display data of many slaves
+  // in one multicast frame. After packet_header: batch_header, shared
+  // text/temperature/time, then count records sorted by id
+  struct alignas(1) batch_header
+  {
+    uint16_t count = {0}; // records in this frame
+    uint16_t frame = {0};
+    uint16_t frames = {0};
+    uint16_t reserved = {0};
+  };
+
+  struct alignas(1) display_record
+  {
+    uint32_t id = {0}; // session id of slave
+    uint16_t brightness = {0};
+    uint8_t flags = {0};
+    uint8_t reserved = {0};
+
+    // No reading from this slave since previous set_data_batch
+    static constexpr uint8_t stale = 0x01;
+  };
+
+  static_assert(sizeof(display_record) == 8, "display_record must have no padding");
+
+  constexpr size_t display_shared_len = display_txt_len + temperature_len + display_time_len;
+  constexpr size_t batch_fixed_len = sizeof(packet_header) + sizeof(batch_header) + display_shared_len;
+  constexpr size_t records_per_frame = 64;
+  constexpr size_t max_batch_len = batch_fixed_len + records_per_frame * sizeof(display_record);
+
+  constexpr size_t max_packet_len = std::max(sizeof(packet_header) + std::max(sizeof(sensor_data) + sizeof(sensor_summary),
+                                                                              sizeof(display_data)),
+                                             max_batch_len);
+
+  // --auth: counter and tag after every packet, datagram buffers have room for them
+  constexpr size_t auth_trailer_len = 16;
+  constexpr size_t max_datagram_len = max_packet_len + auth_trailer_len;
+
+  // Ready-to-send wire images of packet_header of one block, for every
+  // packet_type x block_mode. Built once for block id, so a control packet
+  // is sent straight from here (and never changes while in flight), packets
+  // with payload start with a 20 byte copy instead of encoding.
+  class packet_templates
+  {
+  public:
+    static constexpr int number_of_block_modes = to_idx(packet_header::block_mode::tmp_master) + 1;
+
+    void
+    build(const boost::uuids::uuid &id)
+    {
+      for (int pt = 0; pt < to_idx(packet_header::packet_type::number); ++pt)
+      {
+        for (int m = 0; m < number_of_block_modes; ++m)
+        {
+          packet_header::to_netbuf(images_[pt][m],
+                                   static_cast<packet_header::packet_type>(pt),
+                                   static_cast<packet_header::block_mode>(m),
+                                   id);
+        }
+      }
+    }
+
+    const uint8_t *
+    get(packet_header::packet_type pt, packet_header::block_mode m) const
+    {
+      return images_[to_idx(pt)][to_idx(m)];
+    }
+
+    void
+    to_netbuf(uint8_t *net_buf, packet_header::packet_type pt, packet_header::block_mode m) const
+    {
+      std::memcpy(net_buf, get(pt, m), sizeof(packet_header));
+    }
+
+  private:
+    uint8_t images_[to_idx(packet_header::packet_type::number)][number_of_block_modes][sizeof(packet_header)] = {};
+  };
 } // namespace cbp
\ No newline at end of file
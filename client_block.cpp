@@ -1,151 +1,77 @@
-#include <random>
-#include "control_block.hpp"
+#include "client_block.hpp"
 
 namespace cbp
 {
-  class client_block : public control_block
+  void
+  client_block::start()
   {
-  public:
-    client_block(asio::io_context &io_context,
-                 const asio::ip::address &listen_address,
-                 const asio::ip::address &multicast_address)
-        : control_block(io_context, listen_address, multicast_address),
-          random_temperature(-45, 45),
-          random_brightness(350, 550)
+    // First state span of trace row
+    CBP_TRACE_EVENT(state, this, state_name(), 0);
+
+    // Iniate communication by sending master_needed_request into network,
+    // or by asking master known before restart
+    if (state_file_ && state_file_->restored() &&
+        state_file_->role() == packet_header::block_mode::slave &&
+        !state_file_->master_id().is_nil())
     {
-      // Set correct block's state and mode
-      state_ = waiting_for_master;
-      mode_ = packet_header::block_mode::tmp_master;
-
-      // expand dispatcher 2d-array to cover additional client_block states
-      // i.e. d[7][2] -> d[7][4]
-      for (auto &d : dispatcher_)
-      {
-        for (int n = to_idx(number_of_client_block_states) - to_idx(number_of_control_block_states),
-                 i = 0;
-             i < n; ++i)
-        {
-          d.push_back(std::bind(&client_block::stub, this));
-        }
-      }
-
-      // Set correct packet handlers (i.e. replace the stubs as needed)
-      dispatcher_[to_idx(packet_header::packet_type::master_needed_req)][waiting_for_master] =
-          dispatcher_[to_idx(packet_header::packet_type::master_needed_req)][slave] =
-              std::bind(&client_block::handle_master_needed_request_slave, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::i_am_master_rsp)][waiting_for_slave] =
-          dispatcher_[to_idx(packet_header::packet_type::i_am_master_rsp)][master] =
-              std::bind(&client_block::handle_i_am_master_response_master, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::i_am_master_rsp)][waiting_for_master] =
-          std::bind(&client_block::handle_i_am_master_response_slave, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][waiting_for_slave] =
-          dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][master] =
-              std::bind(&client_block::handle_slave_needed_request_master, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][waiting_for_master] =
-          std::bind(&client_block::handle_slave_needed_request_wm, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][slave] =
-          std::bind(&client_block::handle_slave_needed_request_slave, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::get_data_req)][slave] =
-          std::bind(&client_block::handle_get_data_request, this);
-
-      dispatcher_[to_idx(packet_header::packet_type::set_data)][slave] =
-          std::bind(&client_block::handle_set_data, this);
+      resume_slave();
     }
-
-    void start() override;
-
-  protected:
-    // Four possible states - two control_block states:
-    // waiting_for_slave(0) or master(1)
-    // plus additional
-    // waiting_for_master(2) or slave(3)
-    enum
-    {
-      waiting_for_master = waiting_for_slave + 1,
-      slave,
-      number_of_client_block_states
-    };
-
-    bool is_waiting_for_master() { return (state_ == waiting_for_master); }
-    bool is_slave() { return (state_ == slave); }
-
-    void set_waiting_for_master_state()
+    else
     {
-      print_old_state();
-      state_ = waiting_for_master;
-      print_new_state();
+      send_master_needed();
     }
 
-    void set_slave_state()
-    {
-      print_old_state();
-      state_ = slave;
-      print_new_state();
-    }
-
-    virtual void print_state()
-    {
-      static const char *states[] = {"waiting_for_slave", "master", "waiting_for_master", "slave"};
-      std::cout << states[state_];
-    }
-
-    bool read_sensors_data();
-    void display_data_from_master(const display_data &);
-
-    void send_master_needed();
-    void handle_send_master_needed(const asio::error_code &);
-    void handle_master_needed_sent_tmout(const asio::error_code &);
-
-    void handle_slave_needed_request_slave();
-    void handle_slave_needed_request_master();
-    void handle_slave_needed_request_wm();
-    void handle_master_needed_request_slave();
-    void handle_no_request_from_master_tmout(const asio::error_code &);
-
-    void handle_i_am_master_response_slave();
-    void handle_i_am_master_response_master();
-
-    void handle_get_data_request();
-    void handle_set_data();
+    // listen socket only after all packet handlers are set, though we have stub for unexpected data
+    transport_->async_receive_from(
+        asio::buffer(recv_buf_, sizeof(recv_buf_)), sender_endpoint_,
+        [this](const asio::error_code &error, size_t bytes_recvd)
+        { handle_receive_from(error, bytes_recvd); });
 
-    // Constants
-    static constexpr int attempts_max_master_needed = 3;
+    start_sampling();
+  }
 
-    static constexpr std::chrono::seconds tmout_master_needed_sent = 1s;
-    static constexpr std::chrono::seconds tmout_no_request_from_master =
-        (6 * tmout_get_data_cycle);
+  // Warm restart of slave: unicast master_needed_req to the last master, its
+  // i_am_master_rsp is handled as usual in Wait_for_Master state. No reply
+  // within tmout_resume - full discovery
+  void
+  client_block::resume_slave()
+  {
+    mode_ = packet_header::block_mode::slave;
 
-    // slave-specific data
-    bool oldest_ = {true};
-    sensor_data sensors_ = {{0}, {0}};
+    set_waiting_for_master_state();
+    oldest_ = true;
 
-    boost::uuids::uuid master_block_id_ = {boost::uuids::nil_uuid()};
-    packet_header::block_mode master_mode_ = {packet_header::block_mode::master};
+    master_block_id_ = boost::uuids::nil_uuid();
+    master_key_ = 0;
+    resume_endpoint_ = state_file_->master_endpoint();
 
-    // Sensors data randomizers
-    std::random_device rd;
-    std::uniform_int_distribution<int16_t> random_temperature;
-    std::uniform_int_distribution<uint16_t> random_brightness;
-  };
+    std::cout << "Resuming slave of master ip="
+              << resume_endpoint_.address()
+              << " with id="
+              << state_file_->master_id()
+              << std::endl;
+
+    transport_->async_send_to(header(packet_header::packet_type::master_needed_req),
+                              resume_endpoint_,
+                              [this](const asio::error_code &, size_t)
+                              {
+                                start_timer(tmout_resume, [this](const asio::error_code &e)
+                                            { handle_resume_tmout(e); });
+                              });
+  }
 
   void
-  client_block::start()
+  client_block::handle_resume_tmout(const asio::error_code &e)
   {
-    // Iniate communication by sending slave_needed_request into network
-    send_master_needed();
+    if (e == asio::error::operation_aborted)
+    {
+      return;
+    }
 
-    // listen socket only after all packet handlers are set, though we have stub for unexpected data
-    listen_socket_.async_receive_from(
-        asio::buffer(recv_buf_, sizeof(recv_buf_)), sender_endpoint_,
-        boost::bind(&client_block::handle_receive_from, this,
-                    asio::placeholders::error,
-                    asio::placeholders::bytes_transferred));
+    if (is_waiting_for_master())
+    {
+      send_master_needed();
+    }
   }
 
   void
@@ -157,19 +83,14 @@ namespace cbp
     oldest_ = true;
 
     master_block_id_ = boost::uuids::nil_uuid();
+    master_key_ = 0;
 
     attempts_ = attempts_max_master_needed;
 
     // Send multicast master_needed message
-    packet_header::to_netbuf(send_buf_,
-                             packet_header::packet_type::master_needed_req,
-                             mode_,
-                             block_id_);
-
-    listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
-                                 multicast_endpoint_,
-                                 boost::bind(&client_block::handle_send_master_needed,
-                                             this, asio::placeholders::error));
+    send_discovery(packet_header::packet_type::master_needed_req,
+                   [this](const asio::error_code &error, size_t)
+                   { handle_send_master_needed(error); });
   }
 
   void
@@ -178,9 +99,8 @@ namespace cbp
     // Message sent
     if (!error)
     {
-      timer_.expires_after(tmout_master_needed_sent);
-      timer_.async_wait(boost::bind(&client_block::handle_master_needed_sent_tmout,
-                                    this, asio::placeholders::error));
+      start_timer(tmout_master_needed_sent, [this](const asio::error_code &e)
+                  { handle_master_needed_sent_tmout(e); });
     }
 
     // TODO: need to check error
@@ -201,15 +121,9 @@ namespace cbp
       if (--attempts_)
       {
         // try one more time - multicast master_needed message
-        packet_header::to_netbuf(send_buf_,
-                                 packet_header::packet_type::master_needed_req,
-                                 mode_,
-                                 block_id_);
-
-        listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
-                                     multicast_endpoint_,
-                                     boost::bind(&client_block::handle_send_master_needed,
-                                                 this, asio::placeholders::error));
+        send_discovery(packet_header::packet_type::master_needed_req,
+                       [this](const asio::error_code &error, size_t)
+                       { handle_send_master_needed(error); });
       }
       else if (oldest_)
       {
@@ -225,23 +139,29 @@ namespace cbp
   bool
   client_block::read_sensors_data()
   {
-    sensors_.temperature = random_temperature(rd);
-    sensors_.brightness = random_brightness(rd);
+    sensors_.temperature = random_temperature(random_engine_);
+    sensors_.brightness = random_brightness(random_engine_);
     return true;
   }
 
   void
   client_block::display_data_from_master(const display_data &net_data)
   {
-    std::cout << "Displayed: Time["
-              << net_data.time
-              << "] Info["
-              << net_data.text
-              << "] Temperature["
-              << net_data.temperature
-              << "] Brightness["
-              << ntohs(net_data.brightness) // from net to host
-              << "]" << std::endl;
+    if (renderer_)
+    {
+      renderer_->post(net_data);
+      status_.rendered = renderer_->rendered();
+      status_.render_skipped = renderer_->skipped();
+    }
+    else
+    {
+      display_renderer::draw(std::cout, net_data);
+      ++status_.rendered;
+    }
+
+    status_.display = net_data;
+    status_.display.brightness = ntohs(net_data.brightness);
+    publish_status();
   }
 
   // Called for CBP_MASTER_NEEDED_REQ when IB in Wait_for_Master or Slave state.
@@ -287,18 +207,31 @@ namespace cbp
   // ph_im_rep_process_s replacement
   void
   client_block::handle_i_am_master_response_slave()
+  {
+    follow_master();
+
+    start_timer(tmout_no_request_from_master, [this](const asio::error_code &e)
+                { handle_no_request_from_master_tmout(e); });
+  }
+
+  // Go to Slave state with sender of packet in recv_buf_ as Master
+  void
+  client_block::follow_master()
   {
     mode_ = packet_header::block_mode::slave;
     set_slave_state();
 
     master_block_id_ = packet_header::id_from_netbuf(recv_buf_);
+    master_key_ = packet_header::key_of(master_block_id_);
     master_mode_ = packet_header::mode_from_netbuf(recv_buf_);
+    session_ = 0;
 
     attempts_ = 0;
 
-    timer_.expires_after(tmout_no_request_from_master);
-    timer_.async_wait(boost::bind(&client_block::handle_no_request_from_master_tmout,
-                                  this, asio::placeholders::error));
+    if (state_file_)
+    {
+      state_file_->set_slave(master_block_id_, master_mode_, sender_endpoint_);
+    }
 
     std::cout << "New master is set, ip="
               << sender_endpoint_.address()
@@ -309,6 +242,12 @@ namespace cbp
     packet_header::print_mode(master_mode_);
 
     std::cout << std::endl;
+
+    status_.master_id = master_block_id_;
+    std::snprintf(status_.master_address, sizeof(status_.master_address), "%s",
+                  sender_endpoint_.address().to_string().c_str());
+    status_.master_port = sender_endpoint_.port();
+    publish_status();
   }
 
   // Called for CBP_I_AM_MASTER_REP when IB in Wait_for_Slave or Master state.
@@ -333,15 +272,10 @@ namespace cbp
     handle_i_am_master_response_slave();
 
     // Send response with confirmation
-    packet_header::to_netbuf(send_buf_,
-                             packet_header::packet_type::i_am_slave_rsp,
-                             mode_,
-                             block_id_);
-
-    listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
+    transport_->async_send_to(header(packet_header::packet_type::i_am_slave_rsp),
                                  sender_endpoint_,
-                                 boost::bind(&client_block::handle_send_to, this,
-                                             asio::placeholders::error));
+                                 [this](const asio::error_code &error, size_t)
+                                 { handle_send_to(error); });
   }
 
   // Called for CBP_SLAVE_NEEDED_REQ when IB in Slave state
@@ -378,16 +312,122 @@ namespace cbp
     }
   }
 
+  // --sample: readings on fixed schedule, independent of protocol state.
+  // Timer resolution is one wheel tick, readings due by then are all taken
+  void
+  client_block::start_sampling()
+  {
+    if (samples_)
+    {
+      next_sample_ = block_clock::now();
+      handle_sample_tmout(asio::error_code());
+    }
+  }
+
+  void
+  client_block::handle_sample_tmout(const asio::error_code &e)
+  {
+    if (e == asio::error::operation_aborted)
+    {
+      return;
+    }
+
+    const auto now = block_clock::now();
+
+    // Stalled longer than ring holds, older readings would be overwritten anyway
+    if (now - next_sample_ > sample_period_ * sample_ring::capacity)
+    {
+      next_sample_ = now;
+    }
+
+    for (; next_sample_ <= now; next_sample_ += sample_period_)
+    {
+      read_sensors_data();
+      samples_->push(sensors_);
+    }
+
+    sample_timer_.expires_at(next_sample_, [this](const asio::error_code &e)
+                             { handle_sample_tmout(e); });
+  }
+
+  // get_data_rsp in send_buf_, returns its length. Sensors are read now, or
+  // with --sample summarized since previous request
+  size_t
+  client_block::get_data_response()
+  {
+    const size_t header_len = response_header();
+    uint8_t *payload = send_buf_ + header_len;
+
+    if (!samples_)
+    {
+      read_sensors_data();
+      sensors_.to_payload(payload);
+      return header_len + sizeof(sensors_);
+    }
+
+    if (samples_->empty())
+    {
+      read_sensors_data();
+      samples_->push(sensors_);
+    }
+
+    sensors_ = samples_->last();
+    sensors_.to_payload(payload);
+
+    const sensor_summary summary = samples_->take_summary();
+    summary.to_payload(payload);
+
+    std::cout << "Sensors summary: samples="
+              << summary.count
+              << ", Temperature="
+              << summary.t_min
+              << ".."
+              << summary.t_max
+              << ", Brightness="
+              << summary.b_min
+              << ".."
+              << summary.b_max
+              << std::endl;
+
+    return header_len + sizeof(sensors_) + sizeof(summary);
+  }
+
+  // Header of get_data_rsp in send_buf_: session_header if master gave a
+  // session, packet_header otherwise. Returns its length
+  size_t
+  client_block::response_header()
+  {
+    if (!session_)
+    {
+      templates_.to_netbuf(send_buf_, packet_header::packet_type::get_data_rsp, mode_);
+      return sizeof(packet_header);
+    }
+
+    session_header::to_netbuf(send_buf_, packet_header::packet_type::get_data_rsp, mode_,
+                              session_, session_epoch_);
+    return sizeof(session_header);
+  }
+
   // Called for CBP_GET_DATA_REQ when IB in Slave state
   // ph_gd_req_process replacement
   void
   client_block::handle_get_data_request()
   {
     // Check master block_id, i.e. the packet from our Master
-    if (packet_header::id_from_netbuf(recv_buf_) == master_block_id_)
+    if (from_master())
     {
+      // reset no_request_from_master timer, request for another shard
+      // (master with --shards) shows master is alive as well
+      start_timer(tmout_no_request_from_master, [this](const asio::error_code &e)
+                  { handle_no_request_from_master_tmout(e); });
+
+      if (!polled())
+      {
+        return;
+      }
+
       // process get_data request ...
-      read_sensors_data();
+      const size_t len = get_data_response();
 
       std::cout << "GET DATA request from ip="
                 << sender_endpoint_.address()
@@ -399,23 +439,11 @@ namespace cbp
                 << sensors_.brightness
                 << std::endl;
 
-      // reset no_request_from_master timer
-      timer_.expires_after(tmout_no_request_from_master);
-      timer_.async_wait(boost::bind(&client_block::handle_no_request_from_master_tmout,
-                                    this, asio::placeholders::error));
-
       // send get_data response to master
-      packet_header::to_netbuf(send_buf_,
-                               packet_header::packet_type::get_data_rsp,
-                               mode_,
-                               block_id_);
-
-      sensors_.to_netbuf(send_buf_);
-
-      listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header) + sizeof(sensors_)),
+      transport_->async_send_to(asio::buffer(send_buf_, len),
                                    sender_endpoint_,
-                                   boost::bind(&client_block::handle_send_to, this,
-                                               asio::placeholders::error));
+                                   [this](const asio::error_code &error, size_t)
+                                   { handle_send_to(error); });
     }
   }
 
@@ -425,7 +453,7 @@ namespace cbp
   client_block::handle_set_data()
   {
     // Check master block_id, i.e. the packet from our Master
-    if (packet_header::id_from_netbuf(recv_buf_) == master_block_id_)
+    if (from_master())
     {
       // Display data
       std::cout << "SET DATA from ip="
@@ -437,35 +465,68 @@ namespace cbp
       display_data_from_master(display_data::from_netbuf(recv_buf_));
     }
   }
-} // namespace cbp
 
-int main(int argc, char *argv[])
-{
-  try
+  // Called for CBP_SET_DATA_BATCH when IB in Slave state. Frame without
+  // record of this slave is for others
+  void
+  client_block::handle_set_data_batch()
   {
-    if (argc != 3)
+    display_record r;
+    if (session_ && from_master() &&
+        display_batch::find(recv_buf_, session_, r))
     {
-      std::cerr << "Usage: client_block <listen_address> <multicast_address>\n";
-      std::cerr << "  For IPv4, try:\n";
-      std::cerr << "    client_block 0.0.0.0 239.255.0.1\n";
-      std::cerr << "  For IPv6, try:\n";
-      std::cerr << "    client_block 0::0 ff31::8000:1234\n";
-      return 1;
-    }
-
-    asio::io_context io_context;
+      std::cout << "SET DATA batch from ip="
+                << sender_endpoint_.address()
+                << " with id="
+                << master_block_id_
+                << (r.flags & display_record::stale ? ", stale" : "")
+                << std::endl;
 
-    cbp::client_block ib(io_context,
-                         asio::ip::make_address(argv[1]),
-                         asio::ip::make_address(argv[2]));
-    ib.start();
+      // Same as set_data, brightness of this slave (net order)
+      display_data d;
+      display_batch::shared_from_netbuf(recv_buf_, d);
+      d.brightness = htons(r.brightness);
 
-    io_context.run();
+      display_data_from_master(d);
+    }
   }
-  catch (std::exception &e)
+
+  // Called for CBP_SESSION_ASSIGN when IB in Slave state: master's session
+  // id for get_data_rsp, 0 - master does not know the one in use
+  void
+  client_block::handle_session_assign()
   {
-    std::cerr << "Exception: " << e.what() << "\n";
-  }
+    if (!from_master())
+    {
+      return;
+    }
+
+    session_grant g;
+    g.from_netbuf(recv_buf_);
 
-  return 0;
-}
+    // Master (restarted) dropped the answer with unknown session
+    const bool revoked = session_ && !g.session;
+
+    session_ = g.session;
+    session_epoch_ = g.epoch;
+
+    std::cout << "SESSION ASSIGN from ip="
+              << sender_endpoint_.address()
+              << ", session="
+              << session_
+              << ", epoch="
+              << session_epoch_
+              << std::endl;
+
+    // Answer again with packet_header, so the cycle is not lost (warm
+    // restart polls known slaves only as long as they answer)
+    if (revoked)
+    {
+      const size_t len = get_data_response();
+      transport_->async_send_to(asio::buffer(send_buf_, len),
+                                   sender_endpoint_,
+                                   [this](const asio::error_code &error, size_t)
+                                   { handle_send_to(error); });
+    }
+  }
+} // namespace cbp
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <random>
+#include "control_block.hpp"
+#include "display_renderer.hpp"
+#include "sample_ring.hpp"
+
+namespace cbp
+{
+  class client_block : public control_block
+  {
+  public:
+    client_block(asio::io_context &io_context,
+                 const asio::ip::address &listen_address,
+                 const asio::ip::address &multicast_address,
+                 const block_options &options = block_options())
+        : client_block(io_context,
+                       transport::create(io_context, listen_address, multicast_address, options),
+                       multicast_address, options)
+    {
+    }
+
+    client_block(asio::io_context &io_context,
+                 std::unique_ptr<transport> t,
+                 const asio::ip::address &multicast_address,
+                 const block_options &options)
+        : control_block(io_context, std::move(t), multicast_address, options),
+          sample_timer_(io_context),
+          random_engine_(options.id_seed ? options.id_seed : std::random_device()()),
+          random_temperature(-45, 45),
+          random_brightness(350, 550)
+    {
+      if (options.sample_rate)
+      {
+        samples_ = std::make_unique<sample_ring>();
+        sample_period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(1s) / options.sample_rate;
+      }
+
+      if (options.render_fps)
+      {
+        renderer_ = std::make_unique<display_renderer>(options.render_fps);
+      }
+
+#ifdef CBP_TRACE
+      sample_timer_.trace_as(this, "sample");
+#endif
+
+      // Set correct block's state and mode
+      state_ = waiting_for_master;
+      mode_ = packet_header::block_mode::tmp_master;
+
+      // expand dispatcher 2d-array to cover additional client_block states
+      // i.e. d[7][2] -> d[7][4]
+      for (auto &d : dispatcher_)
+      {
+        for (int n = to_idx(number_of_client_block_states) - to_idx(number_of_control_block_states),
+                 i = 0;
+             i < n; ++i)
+        {
+          d.push_back(std::bind(&client_block::stub, this));
+        }
+      }
+
+      // Set correct packet handlers (i.e. replace the stubs as needed)
+      dispatcher_[to_idx(packet_header::packet_type::master_needed_req)][waiting_for_master] =
+          dispatcher_[to_idx(packet_header::packet_type::master_needed_req)][slave] =
+              std::bind(&client_block::handle_master_needed_request_slave, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::i_am_master_rsp)][waiting_for_slave] =
+          dispatcher_[to_idx(packet_header::packet_type::i_am_master_rsp)][master] =
+              std::bind(&client_block::handle_i_am_master_response_master, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::i_am_master_rsp)][waiting_for_master] =
+          std::bind(&client_block::handle_i_am_master_response_slave, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][waiting_for_slave] =
+          dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][master] =
+              std::bind(&client_block::handle_slave_needed_request_master, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][waiting_for_master] =
+          std::bind(&client_block::handle_slave_needed_request_wm, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::slave_needed_req)][slave] =
+          std::bind(&client_block::handle_slave_needed_request_slave, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::get_data_req)][slave] =
+          std::bind(&client_block::handle_get_data_request, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::set_data)][slave] =
+          std::bind(&client_block::handle_set_data, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::set_data_batch)][slave] =
+          std::bind(&client_block::handle_set_data_batch, this);
+
+      dispatcher_[to_idx(packet_header::packet_type::session_assign)][slave] =
+          std::bind(&client_block::handle_session_assign, this);
+    }
+
+    void start() override;
+
+    const char *state_name() const override
+    {
+      static const char *states[] = {"waiting_for_slave", "master", "waiting_for_master", "slave"};
+      return states[state_];
+    }
+
+    bool is_slave() const { return (state_ == slave); }
+
+  protected:
+    // Four possible states - two control_block states:
+    // waiting_for_slave(0) or master(1)
+    // plus additional
+    // waiting_for_master(2) or slave(3), numbered after control_block ones
+    enum
+    {
+      waiting_for_master = number_of_control_block_states,
+      slave,
+      number_of_client_block_states
+    };
+
+    bool is_waiting_for_master() { return (state_ == waiting_for_master); }
+
+    void set_waiting_for_master_state()
+    {
+      print_old_state();
+      state_ = waiting_for_master;
+      print_new_state();
+    }
+
+    void set_slave_state()
+    {
+      print_old_state();
+      state_ = slave;
+      print_new_state();
+    }
+
+    bool read_sensors_data();
+
+    // get_data_req in recv_buf_ is for this slave: it has no shard selector
+    // or selects shard of this slave
+    bool polled() { return poll_selector::polls(recv_buf_, recv_len_, block_id_); }
+    size_t get_data_response();
+    size_t response_header();
+
+    // Packet in recv_buf_ is from the Master: leading 64 bits of its id are
+    // compared (packet_header::key_from_netbuf)
+    bool from_master() const { return packet_header::key_from_netbuf(recv_buf_) == master_key_; }
+
+    void start_sampling();
+    void handle_sample_tmout(const asio::error_code &);
+    void display_data_from_master(const display_data &);
+
+    void resume_slave();
+    void handle_resume_tmout(const asio::error_code &);
+
+    void send_master_needed();
+    void handle_send_master_needed(const asio::error_code &);
+    void handle_master_needed_sent_tmout(const asio::error_code &);
+
+    void handle_slave_needed_request_slave();
+    void handle_slave_needed_request_master();
+    void handle_slave_needed_request_wm();
+    void handle_master_needed_request_slave();
+    void handle_no_request_from_master_tmout(const asio::error_code &);
+
+    void follow_master();
+    void handle_i_am_master_response_slave();
+    void handle_i_am_master_response_master();
+
+    void handle_get_data_request();
+    void handle_set_data();
+    void handle_set_data_batch();
+    void handle_session_assign();
+
+    // Constants
+    static constexpr int attempts_max_master_needed = 3;
+
+    static constexpr std::chrono::seconds tmout_master_needed_sent = 1s;
+    static constexpr std::chrono::seconds tmout_no_request_from_master =
+        (6 * tmout_get_data_cycle);
+
+    // slave-specific data
+    bool oldest_ = {true};
+    sensor_data sensors_ = {{0}, {0}};
+
+    // --sample: readings between get_data requests, taken on own timer
+    std::unique_ptr<sample_ring> samples_;
+    timer_wheel::timer sample_timer_;
+    std::chrono::steady_clock::duration sample_period_ = {};
+    std::chrono::steady_clock::time_point next_sample_;
+
+    // --render: display drawn on own thread
+    std::unique_ptr<display_renderer> renderer_;
+
+    boost::uuids::uuid master_block_id_ = {boost::uuids::nil_uuid()};
+    uint64_t master_key_ = {0};
+    packet_header::block_mode master_mode_ = {packet_header::block_mode::master};
+
+    // Session given by master, get_data_rsp goes with session_header
+    uint16_t session_ = {0};
+    uint16_t session_epoch_ = {0};
+
+    // Sensors data randomizers: engine seeded once, random_device costs a
+    // system call per number
+    std::mt19937 random_engine_;
+    std::uniform_int_distribution<int16_t> random_temperature;
+    std::uniform_int_distribution<uint16_t> random_brightness;
+  };
+
+} // namespace cbp
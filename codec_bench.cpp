@@ -0,0 +1,359 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+
+#include "client_block.hpp"
+#include "loopback_transport.hpp"
+
+// Wire codec and hot handlers, built optimized by 'make bench'.
+// Blocks print every packet; their output is formatted as usual and thrown
+// away, so handler numbers include the logging cost they have in real runs.
+// Handler cycles go through loopback_transport, a fake peer plays the other
+// side of the protocol.
+
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+  volatile uint64_t sink;
+
+  // Formats everything, keeps nothing
+  class null_buf : public std::streambuf
+  {
+  protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+  };
+
+  // Best of 5 runs of n calls, ns per operation (per_call of them in a call)
+  template <typename F>
+  void
+  measure(const char *name, size_t n, F f, size_t per_call = 1)
+  {
+    double best = 1e300;
+    for (int r = 0; r < 5; ++r)
+    {
+      const auto start = clock_type::now();
+      for (size_t i = 0; i < n; ++i)
+      {
+        f(i);
+      }
+      best = std::min(best, std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / double(n * per_call));
+    }
+
+    std::cerr << std::left << std::setw(32) << name << best << " ns/op" << std::endl;
+  }
+
+  // Protected parts of master made reachable
+  class bench_master : public cbp::control_block
+  {
+  public:
+    using control_block::control_block;
+    using control_block::apply_sensor_data;
+    using control_block::calculate_average;
+    using control_block::send_data;
+  };
+
+  // Other side of the protocol: raw member of loopback network
+  struct fake_peer
+  {
+    explicit fake_peer(cbp::loopback_network &network) : transport(network) {}
+
+    void send(cbp::packet_header::packet_type pt, cbp::packet_header::block_mode mode,
+              const cbp::transport::endpoint &to, size_t payload = 0)
+    {
+      cbp::packet_header::to_netbuf(buf, pt, mode, id);
+      size_t len = sizeof(cbp::packet_header) + payload;
+      if (auth)
+      {
+        len = auth->sign(buf, len, ++counter);
+      }
+      transport.async_send_to(asio::buffer(buf, len), to,
+                              [](const asio::error_code &, size_t) {});
+    }
+
+    // get_data_rsp with session_header, sensor_data is in buf after it
+    void send_session(const cbp::session_grant &grant, const cbp::transport::endpoint &to)
+    {
+      cbp::session_header::to_netbuf(buf, cbp::packet_header::packet_type::get_data_rsp,
+                                     cbp::packet_header::block_mode::slave, grant.session, grant.epoch);
+      transport.async_send_to(asio::buffer(buf, sizeof(cbp::session_header) + sizeof(cbp::sensor_data)), to,
+                              [](const asio::error_code &, size_t) {});
+    }
+
+    void receive()
+    {
+      received = false;
+      transport.async_receive_from(asio::buffer(in, sizeof(in)), from,
+                                   [this](const asio::error_code &error, size_t)
+                                   { received = !error; });
+    }
+
+    cbp::loopback_transport transport;
+    boost::uuids::uuid id = boost::uuids::random_generator()();
+    uint8_t buf[cbp::max_datagram_len] = {0};
+    uint8_t in[cbp::max_datagram_len] = {0};
+    cbp::transport::endpoint from;
+    bool received = {false};
+    const cbp::packet_auth *auth = {nullptr}; // sign as --auth blocks do
+    uint64_t counter = {0};
+  };
+
+  void
+  drain(asio::io_context &io_context)
+  {
+    while (io_context.poll())
+    {
+    }
+  }
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 2)
+  {
+    std::cerr << "Usage: codec_bench [operations]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    codec_bench 1000000\n";
+    return 1;
+  }
+
+  const size_t n = (argc == 2) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const boost::uuids::uuid id = boost::uuids::random_generator()();
+  const auto mode = cbp::packet_header::block_mode::master;
+  const auto multicast_address = asio::ip::make_address("239.255.0.1");
+
+  uint8_t buf[cbp::max_packet_len] = {0};
+  const size_t rsp_len = sizeof(cbp::packet_header) + sizeof(cbp::sensor_data);
+
+  null_buf null;
+  std::cout.rdbuf(&null);
+
+  std::cerr << "operations=" << n << std::endl;
+
+  // Wire codec
+  measure("packet_header::to_netbuf", n * 10, [&](size_t i)
+          {
+            cbp::packet_header::to_netbuf(buf, cbp::packet_header::packet_type(i % 7), mode, id);
+            sink = buf[0];
+          });
+
+  cbp::packet_header::to_netbuf(buf, cbp::packet_header::packet_type::get_data_rsp, mode, id);
+  measure("packet_header::op_from_netbuf", n * 10, [&](size_t)
+          { sink = to_idx(cbp::packet_header::op_from_netbuf(buf)); });
+
+  measure("packet_header::is_packet_valid", n * 10, [&](size_t i)
+          { sink = cbp::packet_header::is_packet_valid(buf, rsp_len - (i & 1)); });
+
+  cbp::sensor_data sensors;
+  measure("sensor_data encode+decode", n * 10, [&](size_t i)
+          {
+            sensors.temperature = int16_t(i);
+            sensors.to_netbuf(buf);
+            sensors.from_netbuf(buf);
+            sink = sensors.brightness;
+          });
+
+  cbp::display_data display;
+  measure("display_data encode+decode", n * 10, [&](size_t i)
+          {
+            display.brightness = uint16_t(i);
+            display.to_netbuf(buf);
+            display = cbp::display_data::from_netbuf(buf);
+            sink = display.brightness;
+          });
+
+  // Packet authentication (--auth), per packet of get_data_rsp size
+  cbp::packet_auth::key_type key;
+  for (size_t k = 0; k < key.size(); ++k)
+  {
+    key[k] = uint8_t(k);
+  }
+  const cbp::packet_auth auth(key);
+
+  cbp::packet_header::to_netbuf(buf, cbp::packet_header::packet_type::get_data_rsp, mode, id);
+  const uint64_t tag = auth.siphash(buf, rsp_len + cbp::packet_auth::counter_len);
+
+  measure("packet_auth::siphash", n * 10, [&](size_t i)
+          {
+            buf[rsp_len - 1] = uint8_t(i);
+            sink = auth.siphash(buf, rsp_len);
+          });
+
+  measure("packet_auth::verify", n * 10, [&](size_t i)
+          {
+            buf[rsp_len - 1] = uint8_t(i);
+            sink = auth.verify(buf, rsp_len, tag);
+          });
+
+  // Batch as deferred_packets::authenticate checks it
+  {
+    const size_t batch = cbp::deferred_packets::auth_batch;
+    static uint8_t packets[batch][cbp::max_packet_len];
+    cbp::packet_auth::signed_packet signed_packets[batch];
+    bool ok[batch];
+
+    for (size_t b = 0; b < batch; ++b)
+    {
+      std::memcpy(packets[b], buf, rsp_len);
+      packets[b][rsp_len - 1] = uint8_t(b);
+      signed_packets[b] = {packets[b], rsp_len, auth.siphash(packets[b], rsp_len + cbp::packet_auth::counter_len)};
+    }
+
+    measure("packet_auth::verify batch", n * 10 / batch, [&](size_t)
+            {
+              auth.verify(signed_packets, batch, ok);
+              sink = ok[batch - 1];
+            },
+            batch);
+  }
+
+  // Handlers over loopback network
+  asio::io_context io_context;
+  cbp::loopback_network network(io_context);
+  fake_peer peer(network);
+
+  // Master: fake slave registers, then streams get_data_rsp
+  {
+    auto t = std::make_unique<cbp::loopback_transport>(network);
+    const auto endpoint = t->local_endpoint();
+    bench_master master(io_context, std::move(t), multicast_address, cbp::block_options());
+
+    master.start();
+    drain(io_context);
+    peer.send(cbp::packet_header::packet_type::i_am_slave_rsp, cbp::packet_header::block_mode::slave, endpoint);
+    drain(io_context);
+
+    measure("calculate_average", n, [&](size_t i)
+            {
+              sensors.temperature = int16_t(i % 90 - 45);
+              master.apply_sensor_data(sensors);
+              master.calculate_average();
+            });
+
+    measure("send_data", n / 10, [&](size_t)
+            {
+              master.send_data();
+              drain(io_context);
+            });
+
+    // Peer inbox holds multicasts of setup and set_data, empty it for session_assign
+    do
+    {
+      peer.receive();
+      drain(io_context);
+    } while (peer.received);
+
+    sensors.to_netbuf(peer.buf);
+    const size_t batch = 64;
+    measure("master get_data_rsp handled", n / batch, [&](size_t)
+            {
+              for (size_t b = 0; b < batch; ++b)
+              {
+                peer.send(cbp::packet_header::packet_type::get_data_rsp, cbp::packet_header::block_mode::slave,
+                          endpoint, sizeof(cbp::sensor_data));
+              }
+              drain(io_context);
+            },
+            batch);
+
+    // Peer was told its session by now, same with session_header
+    cbp::session_grant grant;
+    do
+    {
+      peer.receive();
+      drain(io_context);
+    } while (peer.received &&
+             cbp::packet_header::op_from_netbuf(peer.in) != cbp::packet_header::packet_type::session_assign);
+    grant.from_netbuf(peer.in);
+
+    sensors.to_payload(peer.buf + sizeof(cbp::session_header));
+    measure("master get_data_rsp session", n / batch, [&](size_t)
+            {
+              for (size_t b = 0; b < batch; ++b)
+              {
+                peer.send_session(grant, endpoint);
+              }
+              drain(io_context);
+            },
+            batch);
+
+    std::cerr << "  session=" << grant.session << std::endl;
+  }
+
+  // Same with --auth: fake slave signs, master checks every tag
+  {
+    auto t = std::make_unique<cbp::loopback_transport>(network);
+    const auto endpoint = t->local_endpoint();
+    cbp::block_options options;
+    options.auth = true;
+    options.auth_key = key;
+    bench_master master(io_context, std::move(t), multicast_address, options);
+
+    peer.auth = &auth;
+    master.start();
+    drain(io_context);
+    peer.send(cbp::packet_header::packet_type::i_am_slave_rsp, cbp::packet_header::block_mode::slave, endpoint);
+    drain(io_context);
+
+    sensors.to_netbuf(peer.buf);
+    const size_t batch = 64;
+    measure("master get_data_rsp --auth", n / batch, [&](size_t)
+            {
+              for (size_t b = 0; b < batch; ++b)
+              {
+                peer.send(cbp::packet_header::packet_type::get_data_rsp, cbp::packet_header::block_mode::slave,
+                          endpoint, sizeof(cbp::sensor_data));
+              }
+              drain(io_context);
+            },
+            batch);
+
+    std::cerr << "  auth_failed=" << master.auth_failed() << std::endl;
+    peer.auth = nullptr;
+  }
+
+  // Slave: fake master is followed, then get_data_req -> get_data_rsp round trips
+  {
+    auto t = std::make_unique<cbp::loopback_transport>(network);
+    const auto endpoint = t->local_endpoint();
+    cbp::client_block slave(io_context, std::move(t), multicast_address, cbp::block_options());
+
+    slave.start();
+    drain(io_context);
+    peer.send(cbp::packet_header::packet_type::i_am_master_rsp, mode, endpoint);
+    drain(io_context);
+
+    if (!slave.is_slave())
+    {
+      std::cerr << "slave did not follow fake master, state " << slave.state_name() << std::endl;
+      return 1;
+    }
+
+    // Peer inbox holds multicasts of setup, empty it
+    do
+    {
+      peer.receive();
+      drain(io_context);
+    } while (peer.received);
+
+    uint64_t replies = 0;
+    measure("slave receive->dispatch->reply", n / 10, [&](size_t)
+            {
+              peer.send(cbp::packet_header::packet_type::get_data_req, mode, endpoint);
+              drain(io_context);
+              replies += peer.received;
+              peer.receive();
+            });
+
+    std::cerr << "  replies=" << replies << std::endl;
+  }
+
+  return 0;
+}
@@ -1,8 +1,9 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include "asio.hpp"
-#include "boost/bind/bind.hpp"
 #include "boost/uuid/uuid.hpp"
 #include "boost/uuid/uuid_generators.hpp"
 #include "boost/uuid/uuid_io.hpp"
@@ -15,67 +16,313 @@ namespace cbp
   bool
   control_block::is_packet_valid(size_t bytes_recvd)
   {
-    if (!packet_header::is_packet_valid(recv_buf_, bytes_recvd))
+    // --auth: counter and tag are taken off, the tag signs the packet as it
+    // came and the counter
+    recv_unverified_ = false;
+    if (auth_)
+    {
+      if (bytes_recvd < sizeof(session_header) + packet_auth::trailer_len)
+      {
+        reject_packet("Unauthenticated");
+        return false;
+      }
+
+      bytes_recvd -= packet_auth::trailer_len;
+      recv_counter_ = packet_auth::counter_from_netbuf(recv_buf_ + bytes_recvd);
+      recv_tag_ = packet_auth::tag_from_netbuf(recv_buf_ + bytes_recvd + packet_auth::counter_len);
+    }
+
+    // Short get_data_rsp (session_header) is handled as it came
+    if (session_header::is_session(recv_buf_, bytes_recvd)
+            ? !session_header::is_packet_valid(recv_buf_, bytes_recvd)
+            : !packet_header::is_packet_valid(recv_buf_, bytes_recvd))
     {
       std::cout << "Discarded packet from ip=" 
                 << sender_endpoint_.address() 
                 << std::endl;
+      scheduler_.on_drop();
+      return false;
+    }
+
+    recv_len_ = bytes_recvd;
+
+    if (!read_header())
+    {
+      // Unknown session (previous master run or epoch) is revoked, slave goes
+      // back to packet_header. With --auth only a signed one
+      if (!grants_full() && (!auth_ || auth_->verify(recv_buf_, recv_len_, recv_tag_)) &&
+          sessions_.revoke(recv_session_))
+      {
+        send_grant(0, sender_endpoint_);
+      }
       return false;
     }
     
-    if (packet_header::id_from_netbuf(recv_buf_) == block_id_)
+    if (!recv_session_ && *recv_id_ == block_id_)
     {
       return false;
     }
 
+    // Data packet to be put aside is checked later with the rest of them
+    if (auth_)
+    {
+      recv_unverified_ = deferred_packets::is_data(recv_op_) &&
+                         (!deferred_.empty() || transport_->backlog());
+
+      if (!recv_unverified_ && !auth_->verify(recv_buf_, recv_len_, recv_tag_))
+      {
+        reject_packet("Unauthenticated");
+        return false;
+      }
+
+      if (!recv_unverified_ && !is_fresh())
+      {
+        return false;
+      }
+    }
+
     return true;    
   }
 
+  // --auth: counter of authentic packet in recv_buf_ was not taken from its
+  // sender yet, the one with session_header is looked up by session
+  bool
+  control_block::is_fresh()
+  {
+    if (!auth_)
+    {
+      return true;
+    }
+
+    const bool fresh = recv_session_ ? slave(recv_session_).replay.accept(recv_counter_)
+                                     : replay_->accept(*recv_id_, recv_counter_);
+    if (!fresh)
+    {
+      reject_packet("Replayed");
+    }
+    return fresh;
+  }
+
+  // Valid packet of recv_len_ bytes in recv_buf_: its type, sender and where
+  // payload starts. Packet with session_header stays as it came, sender id is
+  // the one of its session; false if the session is unknown
+  bool
+  control_block::read_header()
+  {
+    if (session_header::is_session(recv_buf_, recv_len_))
+    {
+      const session_header h = session_header::from_netbuf(recv_buf_);
+      recv_op_ = static_cast<packet_header::packet_type>(h.operation);
+      recv_id_ = sessions_.find(h.session, h.epoch);
+      recv_session_ = h.session;
+      recv_header_len_ = sizeof(session_header);
+      return recv_id_;
+    }
+
+    recv_op_ = packet_header::op_from_netbuf(recv_buf_);
+    recv_id_ = &packet_header::id_from_netbuf(recv_buf_);
+    recv_session_ = 0;
+    recv_header_len_ = sizeof(packet_header);
+    return true;
+  }
+
+  // session_assign to slave, one at a time, next one from send completion
+  void
+  control_block::send_grant(uint16_t session, const transport::endpoint &slave)
+  {
+    if (grants_full())
+    {
+      ++overload_.throttled;
+      return;
+    }
+
+    grants_[(grants_head_ + grants_count_++) % max_grants] = {session, slave};
+    if (grants_count_ == 1)
+    {
+      send_grant_next();
+    }
+  }
+
+  void
+  control_block::send_grant_next()
+  {
+    session_grant g;
+    g.session = grants_[grants_head_].session;
+    g.epoch = sessions_.epoch();
+
+    templates_.to_netbuf(grant_buf_, packet_header::packet_type::session_assign, mode_);
+    g.to_netbuf(grant_buf_);
+
+    transport_->async_send_to(asio::buffer(grant_buf_), grants_[grants_head_].slave,
+                              [this](const asio::error_code &, size_t)
+                              {
+                                grants_head_ = (grants_head_ + 1) % max_grants;
+                                if (--grants_count_)
+                                {
+                                  send_grant_next();
+                                }
+                              });
+  }
+
   void
   control_block::stub()
   {
     std::cout << "Stub, (unexpected) packet from ip=" 
               << sender_endpoint_.address() 
               << " with id="
-              << packet_header::id_from_netbuf(recv_buf_)
+              << *recv_id_
               << std::endl;
   }
 
   void
   control_block::start()
   {
-    // Iniate communication by sending slave_needed_request into network
-    send_slave_needed();
+    // First state span of trace row
+    CBP_TRACE_EVENT(state, this, state_name(), 0);
+
+    // Iniate communication by sending slave_needed_request into network,
+    // or by inviting slaves known before restart
+    if (state_file_ && state_file_->restored() &&
+        state_file_->role() == packet_header::block_mode::master && state_file_->slave_count())
+    {
+      resume_master();
+    }
+    else
+    {
+      send_slave_needed();
+    }
 
     // listen socket only after all packet handlers are set, though we have stub for unexpected data
-    listen_socket_.async_receive_from(
+    transport_->async_receive_from(
         asio::buffer(recv_buf_, sizeof(recv_buf_)), sender_endpoint_,
-        boost::bind(&control_block::handle_receive_from, this,
-                    asio::placeholders::error,
-                    asio::placeholders::bytes_transferred));    
+        [this](const asio::error_code &error, size_t bytes_recvd)
+        { handle_receive_from(error, bytes_recvd); });    
   }
 
   void
   control_block::handle_receive_from(const asio::error_code &error,
                                      size_t bytes_recvd)
   {
+    std::chrono::system_clock::time_point received;
+    if (latency_ && !error && transport_->receive_time(received))
+    {
+      latency_->record(std::chrono::system_clock::now() - received);
+    }
+
     if (!error)
     {
-      if (is_packet_valid(bytes_recvd))
+      if (is_packet_valid(bytes_recvd) && !defer_data())
       {  
         // Process incoming packet, listen after reply
-        dispatcher_[to_idx(packet_header::op_from_netbuf(recv_buf_))][state_]();
+        dispatcher_[to_idx(recv_op_)][state_]();
       }
     }
+    else
+    {
+      scheduler_.on_drop();
+    }
+
+    handle_deferred();
 
     if (!error || error == asio::error::message_size)
     {
-      listen_socket_.async_receive_from(asio::buffer(recv_buf_, sizeof(recv_buf_)),
+      transport_->async_receive_from(asio::buffer(recv_buf_, sizeof(recv_buf_)),
                                         sender_endpoint_,
-                                        boost::bind(&control_block::handle_receive_from, this,
-                                                    asio::placeholders::error,
-                                                    asio::placeholders::bytes_transferred));
+                                        [this](const asio::error_code &error, size_t bytes_recvd)
+                                        { handle_receive_from(error, bytes_recvd); });
+    }
+  }
+
+  bool
+  control_block::defer_data()
+  {
+    // --auth decided it already in is_packet_valid
+    if (!recv_unverified_ &&
+        (!deferred_packets::is_data(recv_op_) ||
+         (deferred_.empty() && !transport_->backlog())))
+    {
+      return false;
+    }
+
+    if (!deferred_.push(recv_buf_, recv_len_, sender_endpoint_, recv_counter_, recv_tag_,
+                        recv_unverified_ ? auth_.get() : nullptr, overload_))
+    {
+      reject_packet("Unauthenticated");
     }
+    return true;
+  }
+
+  void
+  control_block::handle_deferred()
+  {
+    if (!start_deferred())
+    {
+      return;
+    }
+
+    while (next_deferred())
+    {
+      dispatcher_[to_idx(recv_op_)][state_]();
+    }
+  }
+
+  bool
+  control_block::start_deferred()
+  {
+    if (deferred_.empty() || transport_->backlog())
+    {
+      return false;
+    }
+
+    // --auth: tags of the whole queue in one batch
+    if (auth_)
+    {
+      if (const size_t failed = deferred_.authenticate(*auth_))
+      {
+        std::cout << "Unauthenticated packets put aside: " << failed << std::endl;
+        auth_failed_ += failed;
+      }
+    }
+
+    return !deferred_.empty();
+  }
+
+  bool
+  control_block::next_deferred()
+  {
+    // Session may be gone with its epoch meanwhile, or (--auth) the counter
+    // was taken already: the packet is skipped
+    do
+    {
+      if (deferred_.empty())
+      {
+        return false;
+      }
+
+      const deferred_packets::packet &p = deferred_.front();
+
+      std::memcpy(recv_buf_, p.data, p.len);
+      recv_len_ = p.len;
+      recv_counter_ = p.counter;
+      sender_endpoint_ = p.from;
+      deferred_.pop();
+    } while (!read_header() || !is_fresh());
+
+    return true;
+  }
+
+  // Discovery multicast within --discovery rate. Over it the packet is not
+  // sent, h is called all the same, so retry timers run as usual
+  void
+  control_block::send_discovery(packet_header::packet_type pt, transport::handler h)
+  {
+    if (!discovery_allowed())
+    {
+      h(asio::error_code(), 0);
+      return;
+    }
+
+    transport_->async_send_to(header(pt), multicast_endpoint_, std::move(h));
   }
 
   void
@@ -88,6 +335,50 @@ namespace cbp
     // TODO: process possible error
   }
 
+  // Warm restart of master: keep master role with the same id (slaves that
+  // still follow it keep answering get_data), invite known slaves by unicast
+  // slave_needed_req and start the first get_data cycle early. If nobody
+  // answers within that cycle - full discovery.
+  void
+  control_block::resume_master()
+  {
+    std::cout << "Resuming master with "
+              << state_file_->slave_count()
+              << " known slave(s)"
+              << std::endl;
+
+    set_master_state();
+
+    // Send get_data request from first (short) cycle timeout
+    attempts_ = 1;
+    cycle_closed_ = false;
+    responses_ = 0;
+    set_data_cycles_ = scheduler_.set_data_cycles();
+    resuming_ = true;
+
+    resume_pos_ = 0;
+    send_resume_next();
+
+    cycle_deadline_ = block_clock::now() + tmout_resume;
+    start_timer(tmout_resume, [this](const asio::error_code &e)
+                { handle_getdata_cycle_tmout(e); });
+  }
+
+  // One unicast at a time, next one from send completion
+  void
+  control_block::send_resume_next()
+  {
+    if (!is_master() || !state_file_->next_slave(resume_pos_, resume_endpoint_))
+    {
+      return;
+    }
+
+    transport_->async_send_to(header(packet_header::packet_type::slave_needed_req),
+                              resume_endpoint_,
+                              [this](const asio::error_code &, size_t)
+                              { send_resume_next(); });
+  }
+
   void
   control_block::send_slave_needed()
   {
@@ -97,15 +388,9 @@ namespace cbp
     attempts_ = attempts_max_slave_needed;
 
     // Send multicast slave_needed message
-    packet_header::to_netbuf(send_buf_,
-                             packet_header::packet_type::slave_needed_req,
-                             mode_,
-                             block_id_);
-
-    listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
-                                 multicast_endpoint_,
-                                 boost::bind(&control_block::handle_send_slave_needed, this,
-                                             asio::placeholders::error));
+    send_discovery(packet_header::packet_type::slave_needed_req,
+                   [this](const asio::error_code &error, size_t)
+                   { handle_send_slave_needed(error); });
   }
 
   void
@@ -114,9 +399,8 @@ namespace cbp
     // Message sent
     if (!error)
     {
-      timer_.expires_after(tmout_slave_needed_sent);
-      timer_.async_wait(boost::bind(&control_block::handle_slave_needed_sent_tmout, 
-                        this, asio::placeholders::error));
+      start_timer(tmout_slave_needed_sent, [this](const asio::error_code &e)
+                  { handle_slave_needed_sent_tmout(e); });
     }
 
     // TODO: need to check error
@@ -129,9 +413,7 @@ namespace cbp
     if (!error)
     {
 
-      timer_.expires_after(tmout_get_data_cycle);
-      timer_.async_wait(boost::bind(&control_block::handle_getdata_cycle_tmout, 
-                        this, asio::placeholders::error));
+      start_cycle_timer();
     }
     // TODO: need to check error
   }
@@ -148,15 +430,9 @@ namespace cbp
     if (is_waiting_for_slave() && --attempts_)
     {
       // try one more time - multicast master_needed message
-      packet_header::to_netbuf(send_buf_,
-                               packet_header::packet_type::slave_needed_req,
-                               mode_,
-                               block_id_);
-
-      listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
-                                   multicast_endpoint_,
-                                   boost::bind(&control_block::handle_send_slave_needed,
-                                               this, asio::placeholders::error));
+      send_discovery(packet_header::packet_type::slave_needed_req,
+                     [this](const asio::error_code &error, size_t)
+                     { handle_send_slave_needed(error); });
     }
     // Otherwise do nothing. Wait for master needed reqs
   }
@@ -176,27 +452,35 @@ namespace cbp
       
       set_master_state();
 
+      if (state_file_)
+      {
+        state_file_->set_master(mode_);
+      }
+
       // Iniate get_data request from getdata cycle timer
       attempts_ = 1;
+      cycle_closed_ = false;
+      responses_ = 0;
 
       // Send set_data after N get_data cycles
-      set_data_cycles_ = set_data_cycles;
+      set_data_cycles_ = scheduler_.set_data_cycles();
 
       // stop current timer and set get_data cycle timer
-      timer_.expires_after(tmout_get_data_cycle);
-      timer_.async_wait(boost::bind(&control_block::handle_getdata_cycle_tmout, 
-                        this, asio::placeholders::error));
+      start_cycle_timer();
     }
 
+    remember_slave(expect_slave());
+
     std::cout << "Another slave IB from ip=" 
               << sender_endpoint_.address()
               << " with id="
-              << packet_header::id_from_netbuf(recv_buf_)
+              << *recv_id_
               << std::endl;
   }
 
   // Timer function. Master mode. Check if there are responses from slaves in previous cycle. If yes, then
   // calculate average for previous cycle, clean accumulators, send getdata request for next cycle.
+  // With --early-cycle the cycle may be already closed by responses, then only next one is started.
   void
   control_block::handle_getdata_cycle_tmout(const asio::error_code &e)
   {
@@ -208,27 +492,28 @@ namespace cbp
     // Still master/temp master
     if (is_master())
     {
-      // At least one response has been received from slave(s), then send another get_data request
-      if (attempts_) 
+      // Tune next cycle by how late this timer fired
+      if (!cycle_closed_)
       {
-        calculate_average();
+        close_cycle();
+      }
+      end_cycle(block_clock::now() - cycle_deadline_);
 
-        attempts_ = 0;
+      // At least one response has been received from slave(s), then send another get_data request
+      if (polling_alive()) 
+      {
+        begin_cycle();
        
-        packet_header::to_netbuf(send_buf_,
-                                 packet_header::packet_type::get_data_req,
-                                 mode_,
-                                 block_id_);
-
-        listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
+        transport_->async_send_to(get_data_request(),
                                     multicast_endpoint_,
-                                    boost::bind(&control_block::handle_send_get_data,
-                                                 this, asio::placeholders::error));
-        // Send set_data
-        if (!--set_data_cycles_)
-        {
-          send_data();
-        }
+                                    [this](const asio::error_code &error, size_t)
+                                    { handle_send_get_data(error); });
+      }
+      else if (resuming_)
+      {
+        // Nobody confirmed warm restart, search for slaves from scratch
+        resuming_ = false;
+        send_slave_needed();
       }
       else
       {
@@ -240,30 +525,178 @@ namespace cbp
 
         // seems no slaves. goto in Waiting for Slave state and wait for master_needed request
         set_waiting_for_slave_state();
+
+        if (state_file_)
+        {
+          state_file_->forget_slaves();
+        }
       }
     }
   }
 
+  // Average of get_data cycle, by its timer or by quorum of responses:
+  // responses so far are averaged and set_data is sent when due
+  void
+  control_block::close_cycle()
+  {
+    if (!shard_aggregates_.empty())
+    {
+      shard_aggregate &a = shard_aggregates_[shard_];
+      a.t_sum = t_accum_;
+      a.b_sum = b_accum_;
+      a.count = count_accum_;
+    }
+
+    if (attempts_)
+    {
+      calculate_average();
+
+      // Send set_data
+      if (set_data_due())
+      {
+        send_data();
+      }
+    }
+  }
+
+  // End of get_data cycle by its timer: next cycle is tuned by all responses
+  // to this one's request, those after an early close included
+  void
+  control_block::end_cycle(std::chrono::steady_clock::duration lag)
+  {
+    bool adjusted;
+
+    if (shard_aggregates_.empty())
+    {
+      adjusted = scheduler_.end_cycle(responses_, lag);
+    }
+    else
+    {
+      // Shard is compared with itself one rotation ago, then replaced
+      shard_aggregate &a = shard_aggregates_[shard_];
+      adjusted = scheduler_.end_cycle(responses_, a.responses, lag);
+      a.responses = responses_;
+    }
+
+    if (adjusted)
+    {
+      set_data_cycles_ = std::min(set_data_cycles_, scheduler_.set_data_cycles());
+
+      std::cout << "Get data cycle adjusted: interval="
+                << scheduler_.interval().count()
+                << "ms, set_data every "
+                << scheduler_.set_data_cycles()
+                << " cycle(s), fleet="
+                << scheduler_.fleet()
+                << std::endl;
+    }
+  }
+
+  // After average of a cycle: set_data every N cycles, or with --push once
+  // average has moved enough since last sent (rate limited by push_min_, the
+  // change is checked again every cycle until sent) or keepalive is due
+  bool
+  control_block::set_data_due()
+  {
+    if (!push_)
+    {
+      return !--set_data_cycles_;
+    }
+
+    const auto since = block_clock::now() - pushed_at_;
+    const int dt = std::abs(average_t_ - pushed_t_);
+    const int db = std::abs(int(data_for_slaves_.brightness) - pushed_b_);
+    const bool moved = (dt && dt >= push_temperature_) || (db && db >= push_brightness_);
+
+    return (moved && since >= push_min_) || since >= push_keepalive_;
+  }
+
   // Setup display block basing on accumulated sensor data (temperature and brightness)
   // and clean accumulated data for next cycle.
   void
   control_block::calculate_average()
   {
-    if (count_accum_)
+    // With --shards over all shards, each as of its last cycle
+    int t = t_accum_, b = b_accum_, n = count_accum_;
+    if (!shard_aggregates_.empty())
+    {
+      t = b = n = 0;
+      for (const auto &a : shard_aggregates_)
+      {
+        t += a.t_sum;
+        b += a.b_sum;
+        n += a.count;
+      }
+    }
+
+    if (n)
     {
-      data_for_slaves_.brightness = b_accum_ / count_accum_;
+      average_t_ = t / n;
+      data_for_slaves_.brightness = b / n;
 
       std::snprintf(reinterpret_cast<char *>(data_for_slaves_.temperature),
-                    temperature_len, "%+02d °C", int(t_accum_ / count_accum_));
+                    temperature_len, "%+02d °C", average_t_);
 
       std::cout << "Average calculated: T="
                 << reinterpret_cast<char *>(data_for_slaves_.temperature)
                 << ", B="
                 << data_for_slaves_.brightness
-                << std::endl;
+                << ", N="
+                << n;
+
+      if (!shard_aggregates_.empty())
+      {
+        std::cout << ", shard "
+                  << shard_
+                  << ": "
+                  << count_accum_;
+      }
+
+      if (samples_accum_)
+      {
+        std::cout << ", samples="
+                  << samples_accum_
+                  << ", T range="
+                  << t_min_
+                  << ".."
+                  << t_max_
+                  << ", B range="
+                  << b_min_
+                  << ".."
+                  << b_max_;
+      }
+
+      std::cout << std::endl;
+
+      if (series_)
+      {
+        const int32_t row[] = {average_t_, data_for_slaves_.brightness, n};
+        series_->append(series_ring::now_ms(), row);
+      }
+    }
+
+    if (latency_)
+    {
+      latency_->print(std::cout);
+    }
+
+    if (status_server_)
+    {
+      status_.interval_ms = scheduler_.interval().count();
+      status_.fleet = fleet();
+      status_.responders = count_accum_;
+      status_.listed = 0;
+      for (const uint16_t session : responders_)
+      {
+        status_.slaves[status_.listed++] = *sessions_.find(session, sessions_epoch_);
+      }
+      status_.display.brightness = data_for_slaves_.brightness;
+      std::memcpy(status_.display.temperature, data_for_slaves_.temperature, temperature_len);
+      responders_.clear();
+      publish_status();
     }
 
-    t_accum_ = b_accum_ = count_accum_ = 0;
+    t_accum_ = b_accum_ = count_accum_ = samples_accum_ = 0;
   }
 
   void
@@ -275,22 +708,94 @@ namespace cbp
     std::snprintf(reinterpret_cast<char*>(data_for_slaves_.text),
                   display_txt_len, "Information message for indication block!");
 
-    //send set_data to slaves
-    packet_header::to_netbuf(send_buf_,
-                            packet_header::packet_type::set_data,
-                            mode_,
-                            block_id_);
+    status_.display = data_for_slaves_;
+    publish_status();
 
-    data_for_slaves_.to_netbuf(send_buf_);
+    if (batch_ && !slave_displays_.empty())
+    {
+      send_batch();
+    }
+    else
+    {
+      //send set_data to slaves
+      templates_.to_netbuf(send_buf_, packet_header::packet_type::set_data, mode_);
 
+      data_for_slaves_.to_netbuf(send_buf_);
 
-    listen_socket_.async_send_to(asio::buffer(send_buf_, 
-                                              sizeof(packet_header) + sizeof(data_for_slaves_)),
-                                 multicast_endpoint_,
-                                 boost::bind(&control_block::handle_send_to,
-                                              this, asio::placeholders::error));
-    // Next packet after N cycles
-    set_data_cycles_ = set_data_cycles;
+      transport_->async_send_to(asio::buffer(send_buf_,
+                                             sizeof(packet_header) + sizeof(data_for_slaves_)),
+                                multicast_endpoint_,
+                                [this](const asio::error_code &error, size_t)
+                                { handle_send_to(error); });
+    }
+
+    // Next packet after N cycles, or on change from what is sent now
+    set_data_cycles_ = scheduler_.set_data_cycles();
+    pushed_t_ = average_t_;
+    pushed_b_ = data_for_slaves_.brightness;
+    pushed_at_ = block_clock::now();
+  }
+
+  // --per-slave: set_data_batch frames of all known slaves instead of
+  // set_data. Slave without reading since previous batch is sent flagged
+  // stale, after one more such batch it is forgotten
+  void
+  control_block::send_batch()
+  {
+    // Previous batch is still going out of frames_
+    if (batch_frames_)
+    {
+      return;
+    }
+
+    // Records are indexed by session, so taking used ones keeps them sorted.
+    // Slave not heard since previous batch goes once more as stale, then
+    // its slot is freed
+    batch_records_.clear();
+    for (auto &r : slave_displays_)
+    {
+      if (!r.id)
+      {
+        continue;
+      }
+
+      batch_records_.push_back(r);
+      if (r.flags & display_record::stale)
+      {
+        r.id = 0;
+      }
+      r.flags |= display_record::stale;
+    }
+
+    batch_frames_ = batch_->encode(templates_, mode_, data_for_slaves_, batch_records_);
+    batch_pos_ = 0;
+
+    std::cout << "Set data batch: slaves="
+              << batch_records_.size()
+              << ", frames="
+              << batch_frames_
+              << std::endl;
+
+    send_batch_next();
+  }
+
+  // One frame at a time, next one from send completion
+  void
+  control_block::send_batch_next()
+  {
+    if (batch_pos_ == batch_frames_)
+    {
+      batch_frames_ = 0;
+      return;
+    }
+
+    transport_->async_send_to(asio::buffer(batch_->frame(batch_pos_), batch_->frame_len(batch_pos_)),
+                              multicast_endpoint_,
+                              [this](const asio::error_code &, size_t)
+                              {
+                                ++batch_pos_;
+                                send_batch_next();
+                              });
   }
 
   // Called for CBP_MASTER_NEEDED_REQ when IB in Wait_for_Slave or Master state.
@@ -300,15 +805,10 @@ namespace cbp
   {
     handle_i_am_slave_response();
 
-    packet_header::to_netbuf(send_buf_,
-                             packet_header::packet_type::i_am_master_rsp,
-                             mode_,
-                             block_id_);
-
-    listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
+    transport_->async_send_to(header(packet_header::packet_type::i_am_master_rsp),
                                  sender_endpoint_,
-                                 boost::bind(&control_block::handle_send_to,
-                                                 this, asio::placeholders::error));
+                                 [this](const asio::error_code &error, size_t)
+                                 { handle_send_to(error); });
   }
 
   // Called for CBP_GET_DATA_REP when IB in Master state
@@ -316,20 +816,82 @@ namespace cbp
   void
   control_block::handle_get_data_response() 
   {
-    // get data from packet
+    // get data from packet, after either header
+    const uint8_t *payload = recv_buf_ + recv_header_len_;
     sensor_data data;
-    data.from_netbuf(recv_buf_);
+    data.from_payload(payload);
 
-    // Store data for average calculation
-    apply_sensor_data(data);
+    // Store data for average calculation, summary of slave readings if any
+    sensor_summary summary;
+    if (recv_len_ == recv_header_len_ + sizeof(data) + sizeof(summary))
+    {
+      summary.from_payload(payload);
+    }
+
+    // Slave still sending packet_header is told its session (again)
+    uint16_t session = recv_session_;
+    if (!session)
+    {
+      session = session_of(*recv_id_);
+      if (!grants_full() && sessions_.notify(session))
+      {
+        send_grant(session, sender_endpoint_);
+      }
+    }
+
+    const slave_state &s = slave(session);
+
+    // Response to the request of this cycle (its shard with --shards). Once
+    // the cycle is closed by quorum its average is done: later responses
+    // only count for the cycle's response total (end_cycle)
+    const bool own_shard = (s.shard == shard_);
+    if (own_shard)
+    {
+      ++responses_;
+    }
+
+    if (own_shard && !cycle_closed_)
+    {
+      if (summary.count)
+      {
+        apply_sensor_summary(summary);
+      }
+      else
+      {
+        apply_sensor_data(data);
+      }
+    }
+
+    if (batch_)
+    {
+      remember_display(session, summary.count ? summary.b_sum / summary.count : data.brightness);
+    }
+
+    if (raw_series_)
+    {
+      // Slave is keyed by 32 bits of id hash, enough to tell series apart
+      const int32_t row[] = {s.series_key, data.temperature, data.brightness};
+      raw_series_->append(series_ring::now_ms(), row);
+    }
 
     // reflect get_data response for get_data_cycle timer
     ++attempts_;
+    resuming_ = false;
+
+    // Late response to previous shard's request is not expected in this one
+    const bool quorum = own_shard && !quorum_.empty() && quorum_[shard_].answered(session);
+
+    remember_slave(session);
+
+    if (status_server_ && responders_.size() < status_snapshot::max_listed)
+    {
+      responders_.push_back(session);
+    }
 
     std::cout << "GET DATA response from ip="
               << sender_endpoint_.address()
               << " with id="
-              << packet_header::id_from_netbuf(recv_buf_)
+              << *recv_id_
               << ". Temperature="
               << data.temperature
               << ". Brightness="
@@ -337,6 +899,13 @@ namespace cbp
               << ". Total responses="
               << attempts_
               << std::endl;
+
+    // Everybody expected has answered, timer only starts next cycle
+    if (quorum && !cycle_closed_)
+    {
+      close_cycle();
+      cycle_closed_ = true;
+    }
   }
 
   // Called for CBP_SLAVE_NEEDED_REQ when CB in Master or Waiting for Slave state
@@ -348,15 +917,10 @@ namespace cbp
     // it must go to Slave state, if sender is CBP_DT_MASTER (i.e. CB), the behavior is currently
     // undefined since we cannot have more than one CB in network. In such a case to avoid races 
     // between CBs we may stop this app
-    packet_header::to_netbuf(send_buf_,
-                             packet_header::packet_type::i_am_master_rsp,
-                             mode_,
-                             block_id_);
-
-    listen_socket_.async_send_to(asio::buffer(send_buf_, sizeof(packet_header)),
+    transport_->async_send_to(header(packet_header::packet_type::i_am_master_rsp),
                                  sender_endpoint_,
-                                 boost::bind(&control_block::handle_send_to,
-                                                 this, asio::placeholders::error));
+                                 [this](const asio::error_code &error, size_t)
+                                 { handle_send_to(error); });
   }
 
   // Called for CBP_I_AM_MASTER_REP when CB in Master or Waiting for Slave state
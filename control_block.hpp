@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <random>
 #include <iostream>
 #include <vector>
 #include <functional>
@@ -7,44 +9,66 @@
 #include <typeinfo>
 
 #include "asio.hpp"
-#include "boost/bind/bind.hpp"
 #include "boost/uuid/uuid.hpp"
 #include "boost/uuid/uuid_generators.hpp"
 #include "boost/uuid/uuid_io.hpp"
 
+#include "block_clock.hpp"
+#include "busy_poll.hpp"
 #include "cbp_base.hpp"
+#include "cycle_quorum.hpp"
+#include "cycle_scheduler.hpp"
+#include "deferred_packets.hpp"
+#include "display_batch.hpp"
+#include "packet_auth.hpp"
+#include "series_ring.hpp"
+#include "session_registry.hpp"
+#include "state_file.hpp"
+#include "status_server.hpp"
+#include "timer_wheel.hpp"
+#include "token_bucket.hpp"
+#include "trace.hpp"
+#include "transport.hpp"
 
 using namespace std::chrono_literals;
 
 namespace cbp
 {
-  const short multicast_port = 30001;
-
   class control_block
   {
   public:
     control_block(asio::io_context &io_context,
                   const asio::ip::address &listen_address,
-                  const asio::ip::address &multicast_address)
-        : listen_socket_(io_context),
-          multicast_socket_(io_context),
+                  const asio::ip::address &multicast_address,
+                  const block_options &options = block_options())
+        : control_block(io_context,
+                        transport::create(io_context, listen_address, multicast_address, options),
+                        multicast_address, options)
+    {
+    }
+
+    // Over given transport, e.g. loopback network of fleet_sim
+    control_block(asio::io_context &io_context,
+                  std::unique_ptr<transport> t,
+                  const asio::ip::address &multicast_address,
+                  const block_options &options)
+        : transport_(std::move(t)),
           multicast_endpoint_(multicast_address, multicast_port),
           timer_(io_context),
           block_id_(boost::uuids::random_generator()()),
           dispatcher_(to_idx(packet_header::packet_type::number),
                       std::vector<std::function<void()>>(number_of_control_block_states,
-                                                         std::bind(&control_block::stub, this)))
+                                                         std::bind(&control_block::stub, this))),
+          scheduler_(options.cycle_min, options.cycle_max, tmout_get_data_cycle,
+                     set_data_cycles * tmout_get_data_cycle),
+          shards_(options.shards),
+          push_(options.push),
+          push_temperature_(options.push_temperature),
+          push_brightness_(options.push_brightness),
+          push_min_(options.push_min),
+          push_keepalive_(options.push_keepalive),
+          discovery_(options.discovery_rate, options.discovery_burst)
     {
-      // Create the socket so that multiple may be bound to the same address.
-      asio::ip::udp::endpoint listen_endpoint(
-          listen_address, multicast_port);
-      listen_socket_.open(listen_endpoint.protocol());
-      listen_socket_.bind(listen_endpoint);
-
-      // Join the multicast group.
-      listen_socket_.set_option(
-          asio::ip::multicast::join_group(multicast_address));
-
       // Set correct packet handlers (i.e. replace stubs as needed)
       dispatcher_[to_idx(packet_header::packet_type::i_am_slave_rsp)][waiting_for_slave] =
           dispatcher_[to_idx(packet_header::packet_type::i_am_slave_rsp)][master] =
@@ -64,10 +88,121 @@ namespace cbp
 
       dispatcher_[to_idx(packet_header::packet_type::get_data_rsp)][master] =
           std::bind(&control_block::handle_get_data_response, this);
+
+      if (options.id_seed)
+      {
+        std::mt19937 engine(options.id_seed);
+        block_id_ = boost::uuids::basic_random_generator<std::mt19937>(engine)();
+      }
+
+      // Same id after restart, so slaves and master still recognize this block
+      if (!options.state_path.empty())
+      {
+        state_file_ = std::make_unique<state_file>(options.state_path);
+
+        if (state_file_->restored())
+        {
+          block_id_ = state_file_->block_id();
+        }
+        else
+        {
+          state_file_->set_block_id(block_id_);
+        }
+      }
+
+      templates_.build(block_id_);
+
+      // Sent packets are signed on the way out, received ones checked by
+      // is_packet_valid
+      if (options.auth)
+      {
+        auth_ = std::make_unique<packet_auth>(options.auth_key);
+        replay_ = std::make_unique<replay_table>();
+        transport_ = std::make_unique<auth_transport>(std::move(transport_), options.auth_key);
+      }
+
+#ifdef CBP_TRACE
+      // One row per block: states, packets and protocol timer
+      trace::name_track(this, "block " + boost::uuids::to_string(block_id_).substr(0, 8));
+      transport_ = trace::traced(std::move(transport_), this);
+      timer_.trace_as(this, "protocol");
+#endif
+
+      if (options.early_cycle > 0)
+      {
+        quorum_.assign(shards_, cycle_quorum(options.early_cycle));
+      }
+
+      if (shards_ > 1)
+      {
+        shard_aggregates_.resize(shards_);
+      }
+
+      if (options.per_slave)
+      {
+        batch_ = std::make_unique<display_batch>();
+      }
+
+      if (options.latency)
+      {
+        latency_ = std::make_unique<latency_histogram>();
+      }
+
+      if (!options.status_path.empty())
+      {
+        status_server_ = std::make_unique<status_server>(options.status_path);
+        responders_.reserve(status_snapshot::max_listed);
+      }
+
+      if (!options.series_dir.empty())
+      {
+        series_ = std::make_unique<series_ring>(options.series_dir + "/average.ring", 3, series_capacity);
+        if (options.series_raw)
+        {
+          raw_series_ = std::make_unique<series_ring>(options.series_dir + "/raw.ring", 3, raw_series_capacity);
+        }
+      }
     }
 
     virtual void start();
 
+    // Switch transport to busy polling, returns descriptors for run_busy_poll
+    std::vector<int> prepare_busy_poll(std::chrono::microseconds spin)
+    {
+      std::vector<int> fds;
+      transport_->set_busy_poll(spin);
+      transport_->poll_fds(fds);
+      return fds;
+    }
+
+    virtual const char *state_name() const
+    {
+      static const char *states[] = {"waiting_for_slave", "master"};
+      return states[state_];
+    }
+
+    bool is_master() const { return (state_ == master); }
+    const cycle_scheduler &scheduler() const { return scheduler_; }
+
+    const overload_counters &overload() const { return overload_; }
+    uint64_t auth_failed() const { return auth_failed_; }
+
+    // Slaves answering get_data, with --shards summed over last rotation
+    double fleet() const
+    {
+      if (shard_aggregates_.empty())
+      {
+        return scheduler_.fleet();
+      }
+
+      double n = 0;
+      for (const auto &a : shard_aggregates_)
+      {
+        n += a.responses;
+      }
+      return n;
+    }
+
   protected:
     // Two possible states - waiting_for_slave(0) or master(1)
     // They are used for dispatch purposes (state machine)
@@ -79,7 +214,6 @@ namespace cbp
     };
     int state_ = {waiting_for_slave};
     bool is_waiting_for_slave() { return (state_ == waiting_for_slave); }
-    bool is_master() { return (state_ == master); }
 
     void set_waiting_for_slave_state()
     {
@@ -95,11 +229,7 @@ namespace cbp
       print_new_state();
     }
 
-    virtual void print_state()
-    {
-      static const char *states[] = {"waiting_for_slave", "master"};
-      std::cout << states[state_];
-    }
+    void print_state() { std::cout << state_name(); }
 
     void print_old_state() { print_state(); }
 
@@ -108,6 +238,9 @@ namespace cbp
       std::cout << " -> ";
       print_state();
       std::cout << std::endl;
+
+      CBP_TRACE_EVENT(state, this, state_name(), 0);
+      publish_status();
     }
 
     int attempts_ = {0};
@@ -121,15 +254,260 @@ namespace cbp
       ++count_accum_;
     }
 
+    // Slave with --sample: its mean counts as one reading, range is kept
+    void apply_sensor_summary(const sensor_summary &ss)
+    {
+      t_accum_ += ss.t_sum / int(ss.count);
+      b_accum_ += ss.b_sum / ss.count;
+      ++count_accum_;
+
+      if (!samples_accum_)
+      {
+        t_min_ = ss.t_min;
+        t_max_ = ss.t_max;
+        b_min_ = ss.b_min;
+        b_max_ = ss.b_max;
+      }
+      samples_accum_ += ss.count;
+      t_min_ = std::min(t_min_, int(ss.t_min));
+      t_max_ = std::max(t_max_, int(ss.t_max));
+      b_min_ = std::min(b_min_, int(ss.b_min));
+      b_max_ = std::max(b_max_, int(ss.b_max));
+    }
+
     bool is_packet_valid(size_t bytes_recvd);
+    bool read_header();
+    bool is_fresh();
+
+    // --auth: packet dropped for missing or wrong tag or counter taken already
+    void reject_packet(const char *reason)
+    {
+      std::cout << reason
+                << " packet from ip="
+                << sender_endpoint_.address()
+                << std::endl;
+      ++auth_failed_;
+    }
+    // session_assign queued unless max_grants are waiting, then it is
+    // dropped (counted as throttled), slaves are told on a later packet
+    void send_grant(uint16_t session, const transport::endpoint &slave);
+    void send_grant_next();
+    bool grants_full() const { return grants_count_ == max_grants; }
+
+    // (Re)arm timer_, previous deadline is dropped in O(1) without posting anything
+    void start_timer(std::chrono::steady_clock::duration tmout, timer_wheel::handler h)
+    {
+      timer_.expires_after(tmout, std::move(h));
+    }
+
+    // Next get_data cycle, its length is chosen by scheduler_
+    void start_cycle_timer()
+    {
+      cycle_deadline_ = block_clock::now() + scheduler_.interval();
+      start_timer(scheduler_.interval(), [this](const asio::error_code &e)
+                  { handle_getdata_cycle_tmout(e); });
+    }
+
+    // Go on polling after a cycle: it had responses or, with --shards, some
+    // cycle of the last rotation had
+    bool polling_alive()
+    {
+      quiet_cycles_ = attempts_ ? 0 : quiet_cycles_ + 1;
+      return quiet_cycles_ < shards_;
+    }
+
+    // get_data_req is about to be sent: responses of new cycle (of next
+    // shard) are awaited
+    void begin_cycle()
+    {
+      attempts_ = 0;
+      responses_ = 0;
+      cycle_closed_ = false;
+      shard_ = (shard_ + 1) % shards_;
+      if (!quorum_.empty())
+      {
+        quorum_[shard_].start();
+      }
+    }
+
+    // get_data_req of current cycle, selects its shard with --shards
+    asio::const_buffer get_data_request()
+    {
+      if (shards_ == 1)
+      {
+        return header(packet_header::packet_type::get_data_req);
+      }
+
+      templates_.to_netbuf(poll_buf_, packet_header::packet_type::get_data_req, mode_);
+      poll_selector{shard_, shards_}.to_netbuf(poll_buf_);
+      return asio::buffer(poll_buf_);
+    }
+
+    // Per slave state by session, get_data_rsp does not look at block id:
+    // its shard, key of --series raw rows, --state slot (of generation) and
+    // --auth counters taken
+    struct slave_state
+    {
+      bool known = {false};
+      uint16_t shard = {0};
+      int32_t series_key = {0};
+      int state_slot = {-1};
+      unsigned state_generation = {0};
+      replay_window replay;
+    };
+
+    // Session of slave id, new one if not known yet. Ids ran out and started
+    // over: everything kept by old ones is dropped
+    uint16_t session_of(const boost::uuids::uuid &id)
+    {
+      const uint16_t session = sessions_.assign(id);
+      if (sessions_.epoch() != sessions_epoch_)
+      {
+        sessions_epoch_ = sessions_.epoch();
+        slaves_.clear();
+        slave_displays_.clear();
+        responders_.clear();
+        for (auto &q : quorum_)
+        {
+          q = cycle_quorum(q.quorum());
+        }
+      }
+      return session;
+    }
+
+    // Per slave state of session, worked out from sender id (recv_id_) on
+    // its first packet
+    slave_state &slave(uint16_t session)
+    {
+      if (session >= slaves_.size())
+      {
+        slaves_.resize(session + 1);
+      }
+
+      slave_state &s = slaves_[session];
+      if (!s.known)
+      {
+        s.shard = poll_selector::shard_of(*recv_id_, shards_);
+        s.series_key = int32_t(boost::uuids::hash_value(*recv_id_));
+        s.known = true;
+      }
+      return s;
+    }
+
+    // Registered slave (sender of packet in recv_buf_) has session from now
+    // on and answers requests of its shard
+    uint16_t expect_slave()
+    {
+      const uint16_t session = session_of(*recv_id_);
+      if (!quorum_.empty())
+      {
+        quorum_[slave(session).shard].add(session);
+      }
+      return session;
+    }
+
+    void close_cycle();
+    void end_cycle(std::chrono::steady_clock::duration lag);
+    bool set_data_due();
+
+    // --per-slave: own reading of responding slave, by its session
+    void remember_display(uint16_t session, uint16_t brightness)
+    {
+      if (session >= slave_displays_.size())
+      {
+        slave_displays_.resize(session + 1);
+      }
+
+      display_record &r = slave_displays_[session];
+      r.id = session;
+      r.brightness = brightness;
+      r.flags = 0;
+    }
 
     void stub();
     void calculate_average();
     void send_data();
+    void send_batch();
+    void send_batch_next();
 
     void handle_receive_from(const asio::error_code &, size_t);
     void handle_send_to(const asio::error_code &);
 
+    // Overload protection: data packet in recv_buf_ is put aside while more
+    // datagrams wait in transport (or earlier ones are put aside already),
+    // returns true if it was
+    bool defer_data();
+    // Data packets put aside, once transport has nothing more. recv_buf_ is
+    // reused, so only while no receive is outstanding
+    void handle_deferred();
+    // Same in steps, for engines with their own dispatch: start_deferred()
+    // is false unless packets are due (tags are checked here), then every
+    // next_deferred() loads one into recv_buf_ until it returns false
+    bool start_deferred();
+    bool next_deferred();
+
+    void send_discovery(packet_header::packet_type pt, transport::handler h);
+
+    // --discovery: one more discovery multicast may be sent now, if not it
+    // is counted as throttled
+    bool discovery_allowed()
+    {
+      if (discovery_.take(token_bucket::clock::now()))
+      {
+        return true;
+      }
+
+      ++overload_.throttled;
+      return false;
+    }
+
+    // Bare header of packet type in current mode_, ready to send
+    asio::const_buffer header(packet_header::packet_type pt) const
+    {
+      return asio::buffer(templates_.get(pt, mode_), sizeof(packet_header));
+    }
+
+    // --status: stamp and hand status_ over to status server thread
+    void publish_status()
+    {
+      if (status_server_)
+      {
+        status_.updated_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+        status_.state = state_name();
+        status_.mode = mode_;
+        status_.block_id = block_id_;
+        status_.overload = overload_;
+        status_.auth_failed = auth_failed_;
+        status_server_->publish(status_);
+      }
+    }
+
+    // --state: sender of packet in recv_buf_ goes to slave set, then it is
+    // updated by the slot kept with its session
+    void remember_slave(uint16_t session)
+    {
+      if (!state_file_)
+      {
+        return;
+      }
+
+      slave_state &s = slave(session);
+      if (s.state_slot < 0 || s.state_generation != state_file_->generation())
+      {
+        s.state_slot = state_file_->remember_slave(*recv_id_, sender_endpoint_);
+        s.state_generation = state_file_->generation();
+      }
+      else
+      {
+        state_file_->update_slave(s.state_slot, sender_endpoint_);
+      }
+    }
+
+    void resume_master();
+    void send_resume_next();
+
     void send_slave_needed();
     void handle_send_slave_needed(const asio::error_code &);
     void handle_slave_needed_sent_tmout(const asio::error_code &);
@@ -145,32 +523,136 @@ namespace cbp
 
     // Constants
     static constexpr int attempts_max_slave_needed = 2;
+    // Initial cadence, cycle_scheduler keeps set_data period of 6 * 5s
     static constexpr int set_data_cycles = 6;
 
     static constexpr std::chrono::seconds tmout_slave_needed_sent = 3s;
+    // Initial get_data cycle, then adapted within --cycle bounds
     static constexpr std::chrono::seconds tmout_get_data_cycle = 5s;
+    // Warm restart: wait for handshake reply before full discovery
+    static constexpr std::chrono::milliseconds tmout_resume = 500ms;
+
+    static constexpr unsigned max_grants = 256;
+    // Rows of --series rings: ~18h of 1s cycles, 1M slave readings
+    static constexpr uint64_t series_capacity = 1 << 16;
+    static constexpr uint64_t raw_series_capacity = 1 << 20;
 
     // Data
-    asio::ip::udp::socket listen_socket_;
-    asio::ip::udp::socket multicast_socket_;
+    std::unique_ptr<transport> transport_;
     asio::ip::udp::endpoint multicast_endpoint_;
     asio::ip::udp::endpoint sender_endpoint_;
 
-    asio::steady_timer timer_;
+    timer_wheel::timer timer_;
     boost::uuids::uuid block_id_;
 
     // 2-d array of functions (state machine)
     std::vector<std::vector<std::function<void()>>> dispatcher_;
 
-    uint8_t recv_buf_[max_packet_len] = {0};
+    uint8_t recv_buf_[max_datagram_len] = {0};
+    size_t recv_len_ = {0};
+    // Header of packet in recv_buf_ as read_header() found it: sender block
+    // id (in recv_buf_ or sessions_), session if it came with session_header
+    packet_header::packet_type recv_op_ = {packet_header::packet_type::number};
+    const boost::uuids::uuid *recv_id_ = {nullptr};
+    uint16_t recv_session_ = {0};
+    size_t recv_header_len_ = {sizeof(packet_header)};
+    uint64_t recv_counter_ = {0}; // --auth counter and tag that came after packet
+    uint64_t recv_tag_ = {0};
+    bool recv_unverified_ = {false}; // tag to be checked when put aside
     uint8_t send_buf_[max_packet_len] = {0};
+    packet_templates templates_;
+
+    // Warm restart (--state)
+    std::unique_ptr<state_file> state_file_;
+    transport::endpoint resume_endpoint_;
+    unsigned resume_pos_ = {0};
+    bool resuming_ = {false};
 
     // master-specific data
     int t_accum_ = {0};
     int b_accum_ = {0};
     int count_accum_ = {0};
+    // Readings summarized by slaves in this cycle and their range
+    int samples_accum_ = {0};
+    int t_min_ = {0};
+    int t_max_ = {0};
+    int b_min_ = {0};
+    int b_max_ = {0};
     int set_data_cycles_ = {0};
+    cycle_scheduler scheduler_;
+    // --early-cycle: cycle is closed by quorum of responses, its timer then
+    // only starts next one. One per shard
+    std::vector<cycle_quorum> quorum_;
+    bool cycle_closed_ = {false};
+    int responses_ = {0}; // to get_data_req of this cycle, also after it was closed
+    // --shards: shard polled in current cycle and aggregates of every shard
+    // from its last cycle, averaged together
+    struct shard_aggregate
+    {
+      int t_sum = {0};
+      int b_sum = {0};
+      int count = {0};     // readings averaged, until the cycle was closed
+      int responses = {0}; // all responses to the shard's request
+    };
+    uint16_t shards_;
+    uint16_t shard_ = {0};
+    int quiet_cycles_ = {0};
+    std::vector<shard_aggregate> shard_aggregates_;
+    uint8_t poll_buf_[sizeof(packet_header) + sizeof(poll_selector)] = {0};
+    // Session ids of slaves and session_assign packets being sent
+    session_registry sessions_;
+    uint16_t sessions_epoch_ = {sessions_.epoch()};
+    std::vector<slave_state> slaves_; // by session
+    struct grant
+    {
+      uint16_t session;
+      transport::endpoint slave;
+    };
+    std::array<grant, max_grants> grants_; // ring, sent one at a time
+    unsigned grants_head_ = {0};
+    unsigned grants_count_ = {0};
+    uint8_t grant_buf_[sizeof(packet_header) + sizeof(session_grant)] = {0};
+    // --per-slave: display records of slaves (by session, id 0 - none) and
+    // frames being sent
+    std::unique_ptr<display_batch> batch_;
+    std::vector<display_record> slave_displays_;
+    std::vector<display_record> batch_records_;
+    size_t batch_frames_ = {0};
+    size_t batch_pos_ = {0};
+    // --push: thresholds and last average sent
+    bool push_;
+    int push_temperature_;
+    int push_brightness_;
+    std::chrono::milliseconds push_min_;
+    std::chrono::seconds push_keepalive_;
+    int average_t_ = {0};
+    int pushed_t_ = {0};
+    int pushed_b_ = {0};
+    std::chrono::steady_clock::time_point pushed_at_;
+    std::unique_ptr<latency_histogram> latency_;
+    // --series: averages (temperature, brightness, responses) and
+    // raw readings (slave, temperature, brightness)
+    std::unique_ptr<series_ring> series_;
+    std::unique_ptr<series_ring> raw_series_;
+
+    // --status: kept up to date, published on changes; responders of
+    // current cycle (sessions) go to status_ when it ends
+    std::unique_ptr<status_server> status_server_;
+    status_snapshot status_;
+    std::vector<uint16_t> responders_;
+    std::chrono::steady_clock::time_point cycle_deadline_;
     display_data data_for_slaves_;
+
+    // Overload protection: discovery rate and data packets put aside
+    token_bucket discovery_;
+    deferred_packets deferred_;
+    overload_counters overload_;
+
+    // --auth: key, counters taken from senders of packet_header and packets
+    // dropped (too short, wrong tag or counter taken already)
+    std::unique_ptr<packet_auth> auth_;
+    std::unique_ptr<replay_table> replay_;
+    uint64_t auth_failed_ = {0};
   };
 
 } // namespace cbp
\ No newline at end of file
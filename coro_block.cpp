@@ -0,0 +1,455 @@
+#include "coro_block.hpp"
+
+namespace cbp
+{
+  coro_block::coro_block(asio::io_context &io_context,
+                         std::unique_ptr<transport> t,
+                         const asio::ip::address &multicast_address,
+                         const block_options &options,
+                         bool control)
+      : client_block(io_context, std::move(t), multicast_address, options),
+        control_(control)
+  {
+    if (control_)
+    {
+      state_ = waiting_for_slave;
+      mode_ = packet_header::block_mode::master;
+    }
+  }
+
+  void
+  coro_block::start()
+  {
+    // First state span of trace row
+    CBP_TRACE_EVENT(state, this, state_name(), 0);
+
+    run_ = run();
+    run_.start();
+    start_sampling();
+  }
+
+  coro_task<void>
+  coro_block::run()
+  {
+    loop next = control_ ? loop::master : loop::find_master;
+
+    // Warm restart in the role saved before, as callback engine does
+    if (state_file_ && state_file_->restored())
+    {
+      if (control_ && state_file_->role() == packet_header::block_mode::master && state_file_->slave_count())
+      {
+        next = loop::resume_master;
+      }
+      else if (!control_ && state_file_->role() == packet_header::block_mode::slave &&
+               !state_file_->master_id().is_nil())
+      {
+        next = loop::resume_slave;
+      }
+    }
+
+    for (;;)
+    {
+      next = (next == loop::master || next == loop::resume_master) ? co_await master_loop(next)
+                                                                    : co_await slave_loop(next);
+    }
+  }
+
+  // First slave appears - go to Master mode, get_data request is sent after first cycle
+  void
+  coro_block::lead_slaves()
+  {
+    if (is_waiting_for_slave())
+    {
+      mode_ = control_ ? packet_header::block_mode::master : packet_header::block_mode::tmp_master;
+      set_master_state();
+
+      if (state_file_)
+      {
+        state_file_->set_master(mode_);
+      }
+
+      attempts_ = 1;
+      cycle_closed_ = false;
+      responses_ = 0;
+      set_data_cycles_ = scheduler_.set_data_cycles();
+    }
+
+    remember_slave(expect_slave());
+
+    std::cout << "Another slave IB from ip="
+              << sender_endpoint_.address()
+              << " with id="
+              << *recv_id_
+              << std::endl;
+  }
+
+  // Waiting_for_slave and Master states: search for slaves, then get_data cycles
+  coro_task<coro_block::loop>
+  coro_block::master_loop(loop entry)
+  {
+    clock::time_point deadline;
+
+    if (entry == loop::resume_master)
+    {
+      // Warm restart: known slaves are invited by unicast, first cycle is short
+      std::cout << "Resuming master with "
+                << state_file_->slave_count()
+                << " known slave(s)"
+                << std::endl;
+
+      set_master_state();
+      attempts_ = 1;
+      cycle_closed_ = false;
+      responses_ = 0;
+      set_data_cycles_ = scheduler_.set_data_cycles();
+      resuming_ = true;
+      deadline = clock::now() + tmout_resume;
+
+      resume_pos_ = 0;
+      while (state_file_->next_slave(resume_pos_, resume_endpoint_))
+      {
+        co_await async_send(header(packet_header::packet_type::slave_needed_req), resume_endpoint_);
+      }
+    }
+    else
+    {
+      set_waiting_for_slave_state();
+      attempts_ = attempts_max_slave_needed;
+
+      if (discovery_allowed())
+      {
+        co_await async_send(header(packet_header::packet_type::slave_needed_req), multicast_endpoint_);
+      }
+
+      deadline = clock::now() + tmout_slave_needed_sent;
+    }
+
+    for (;;)
+    {
+      auto [error, bytes_recvd] = co_await receive_or_timeout(deadline);
+
+      // Packet just received, then ones put aside under overload, all through
+      // the switch below, so deadline and sends stay with this loop. Not after
+      // a timeout: receive is still posted into recv_buf_
+      bool ready = !error && is_packet_valid(bytes_recvd) && !defer_data();
+      const bool replay = error != asio::error::timed_out && start_deferred();
+
+      while (ready || (replay && next_deferred()))
+      {
+        ready = false;
+        const auto mode = packet_header::mode_from_netbuf(recv_buf_);
+
+        switch (recv_op_)
+        {
+        case packet_header::packet_type::i_am_slave_rsp:
+          if (is_waiting_for_slave())
+          {
+            deadline = clock::now() + scheduler_.interval();
+          }
+          lead_slaves();
+          break;
+
+        case packet_header::packet_type::master_needed_req:
+          if (is_waiting_for_slave())
+          {
+            deadline = clock::now() + scheduler_.interval();
+          }
+          lead_slaves();
+
+          co_await async_send(header(packet_header::packet_type::i_am_master_rsp), sender_endpoint_);
+          break;
+
+        case packet_header::packet_type::slave_needed_req:
+          if (control_)
+          {
+            handle_slave_needed_request();
+          }
+          else if (mode == packet_header::block_mode::master ||
+                   (mode == packet_header::block_mode::tmp_master &&
+                    *recv_id_ > block_id_))
+          {
+            co_return loop::follow_confirm;
+          }
+          break;
+
+        case packet_header::packet_type::i_am_master_rsp:
+          if (control_)
+          {
+            handle_i_am_master_response();
+          }
+          else if (mode == packet_header::block_mode::master)
+          {
+            co_return loop::follow;
+          }
+          break;
+
+        case packet_header::packet_type::get_data_rsp:
+          if (is_master())
+          {
+            handle_get_data_response();
+            break;
+          }
+          stub();
+          break;
+
+        default:
+          stub();
+          break;
+        }
+      }
+
+      if (clock::now() < deadline)
+      {
+        continue;
+      }
+
+      if (is_waiting_for_slave())
+      {
+        if (--attempts_ > 0)
+        {
+          // try one more time - multicast slave_needed message
+          if (discovery_allowed())
+          {
+            co_await async_send(header(packet_header::packet_type::slave_needed_req), multicast_endpoint_);
+          }
+          deadline = clock::now() + tmout_slave_needed_sent;
+        }
+        else
+        {
+          // Wait for master needed reqs
+          deadline = clock::time_point::max();
+        }
+      }
+      else if (polling_alive())
+      {
+        // At least one response in previous cycle (unless closed by
+        // --early-cycle already), start next one
+        if (!cycle_closed_)
+        {
+          close_cycle();
+        }
+        end_cycle(clock::now() - deadline);
+        begin_cycle();
+
+        co_await async_send(get_data_request(), multicast_endpoint_);
+        deadline = clock::now() + scheduler_.interval();
+      }
+      else if (resuming_)
+      {
+        // Nobody confirmed warm restart, search for slaves from scratch
+        resuming_ = false;
+        co_return loop::master;
+      }
+      else
+      {
+        // Seems no slaves, wait for master_needed request
+        mode_ = control_ ? packet_header::block_mode::master : packet_header::block_mode::tmp_master;
+        set_waiting_for_slave_state();
+
+        if (state_file_)
+        {
+          state_file_->forget_slaves();
+        }
+        deadline = clock::time_point::max();
+      }
+    }
+  }
+
+  // Waiting_for_master and Slave states: search for master, then serve its requests
+  coro_task<coro_block::loop>
+  coro_block::slave_loop(loop entry)
+  {
+    clock::time_point deadline;
+
+    if (entry == loop::find_master || entry == loop::resume_slave)
+    {
+      mode_ = packet_header::block_mode::slave;
+      set_waiting_for_master_state();
+      oldest_ = true;
+      master_block_id_ = boost::uuids::nil_uuid();
+      master_key_ = 0;
+      attempts_ = attempts_max_master_needed;
+
+      if (entry == loop::resume_slave)
+      {
+        // Warm restart: ask the last master by unicast. No reply within
+        // tmout_resume - full discovery, which takes one more attempt
+        resume_endpoint_ = state_file_->master_endpoint();
+
+        std::cout << "Resuming slave of master ip="
+                  << resume_endpoint_.address()
+                  << " with id="
+                  << state_file_->master_id()
+                  << std::endl;
+
+        ++attempts_;
+        co_await async_send(header(packet_header::packet_type::master_needed_req), resume_endpoint_);
+        deadline = clock::now() + tmout_resume;
+      }
+      else
+      {
+        if (discovery_allowed())
+        {
+          co_await async_send(header(packet_header::packet_type::master_needed_req), multicast_endpoint_);
+        }
+        deadline = clock::now() + tmout_master_needed_sent;
+      }
+    }
+    else
+    {
+      // Packet from the new Master is still in recv_buf_
+      follow_master();
+      deadline = clock::now() + tmout_no_request_from_master;
+
+      if (entry == loop::follow_confirm)
+      {
+        co_await async_send(header(packet_header::packet_type::i_am_slave_rsp), sender_endpoint_);
+      }
+    }
+
+    for (;;)
+    {
+      auto [error, bytes_recvd] = co_await receive_or_timeout(deadline);
+
+      // Packet just received, then ones put aside under overload, all through
+      // the switch below, so deadline and sends stay with this loop. Not after
+      // a timeout: receive is still posted into recv_buf_
+      bool ready = !error && is_packet_valid(bytes_recvd) && !defer_data();
+      const bool replay = error != asio::error::timed_out && start_deferred();
+
+      while (ready || (replay && next_deferred()))
+      {
+        ready = false;
+        const auto &id = *recv_id_;
+        const auto mode = packet_header::mode_from_netbuf(recv_buf_);
+        bool confirm = false;
+
+        switch (recv_op_)
+        {
+        case packet_header::packet_type::master_needed_req:
+          handle_master_needed_request_slave();
+          break;
+
+        case packet_header::packet_type::i_am_master_rsp:
+          if (is_waiting_for_master())
+          {
+            follow_master();
+            deadline = clock::now() + tmout_no_request_from_master;
+            break;
+          }
+          stub();
+          break;
+
+        case packet_header::packet_type::slave_needed_req:
+          // Any master while waiting; temp master may be replaced by CB or by
+          // temp master with greater block_id
+          if (is_waiting_for_master() ||
+              (master_mode_ == packet_header::block_mode::tmp_master &&
+               (id > master_block_id_ || mode == packet_header::block_mode::master)))
+          {
+            follow_master();
+            deadline = clock::now() + tmout_no_request_from_master;
+            confirm = true;
+          }
+          break;
+
+        case packet_header::packet_type::get_data_req:
+          if (is_slave() && from_master())
+          {
+            deadline = clock::now() + tmout_no_request_from_master;
+            if (!polled())
+            {
+              break;
+            }
+
+            const size_t len = get_data_response();
+
+            std::cout << "GET DATA request from ip="
+                      << sender_endpoint_.address()
+                      << " with id="
+                      << master_block_id_
+                      << ". Current Temperature="
+                      << sensors_.temperature
+                      << ", Brightness="
+                      << sensors_.brightness
+                      << std::endl;
+
+            co_await async_send(asio::buffer(send_buf_, len), sender_endpoint_);
+            break;
+          }
+          if (!is_slave())
+          {
+            stub();
+          }
+          break;
+
+        case packet_header::packet_type::set_data:
+          if (is_slave())
+          {
+            handle_set_data();
+            break;
+          }
+          stub();
+          break;
+
+        case packet_header::packet_type::set_data_batch:
+          if (is_slave())
+          {
+            handle_set_data_batch();
+            break;
+          }
+          stub();
+          break;
+
+        case packet_header::packet_type::session_assign:
+          if (is_slave())
+          {
+            handle_session_assign();
+            break;
+          }
+          stub();
+          break;
+
+        default:
+          stub();
+          break;
+        }
+
+        if (confirm)
+        {
+          co_await async_send(header(packet_header::packet_type::i_am_slave_rsp), sender_endpoint_);
+        }
+      }
+
+      if (clock::now() < deadline)
+      {
+        continue;
+      }
+
+      if (is_slave())
+      {
+        // No get_data request from master within configured interval
+        co_return loop::find_master;
+      }
+
+      if (--attempts_ > 0)
+      {
+        // try one more time - multicast master_needed message
+        if (discovery_allowed())
+        {
+          co_await async_send(header(packet_header::packet_type::master_needed_req), multicast_endpoint_);
+        }
+        deadline = clock::now() + tmout_master_needed_sent;
+      }
+      else if (oldest_)
+      {
+        // No older IBs after N attempts, so I'll be temporary master
+        co_return loop::master;
+      }
+      else
+      {
+        deadline = clock::time_point::max();
+      }
+    }
+  }
+} // namespace cbp
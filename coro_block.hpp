@@ -0,0 +1,194 @@
+#pragma once
+
+#include "client_block.hpp"
+#include "coro_task.hpp"
+
+namespace cbp
+{
+  // Coroutine protocol engine (--engine=coro, build with CORO=1).
+  // Same protocol as the callback engine, but election and data cycle are
+  // written as two coroutines: master_loop (waiting_for_slave/master states)
+  // and slave_loop (waiting_for_master/slave states), run one at a time by
+  // run(). Every wait is "receive a packet or time out" on transport and
+  // timer_. Coroutines are coro_task (C++20 only, no asio::awaitable): frames
+  // come from coro_frames base, reused by every master/slave switch, and
+  // waits are awaiters over transport and timer_wheel callbacks, so nothing
+  // is allocated per packet.
+  // State, buffers and non-timer packet handlers are shared with the callback
+  // engine, dispatcher_ is not used: packets put aside under overload are
+  // replayed through the switch of the loop too (start_deferred and
+  // next_deferred), so callback handlers never re-arm timer_ behind it.
+  // With control == true the block behaves as control_block (never a slave).
+  class coro_block : public client_block, private coro_frames
+  {
+  public:
+    coro_block(asio::io_context &io_context,
+               const asio::ip::address &listen_address,
+               const asio::ip::address &multicast_address,
+               const block_options &options,
+               bool control)
+        : coro_block(io_context,
+                     transport::create(io_context, listen_address, multicast_address, options),
+                     multicast_address, options, control)
+    {
+    }
+
+    coro_block(asio::io_context &io_context,
+               std::unique_ptr<transport> t,
+               const asio::ip::address &multicast_address,
+               const block_options &options,
+               bool control);
+
+    void start() override;
+
+  protected:
+    using clock = block_clock;
+
+    // Loop to run next. Slave loop is entered either from scratch (find_master)
+    // or with packet in recv_buf_ from the new Master (follow, follow_confirm).
+    // --state: warm restart enters either loop with resume_*
+    enum class loop
+    {
+      master,
+      resume_master,
+      find_master,
+      resume_slave,
+      follow,
+      follow_confirm
+    };
+
+    coro_task<void> run();
+    coro_task<loop> master_loop(loop entry);
+    coro_task<loop> slave_loop(loop entry);
+
+    // Packet into recv_buf_ or deadline (error timed_out), whichever comes
+    // first. Deadline does not cancel the receive: it stays posted for the next
+    // wait, so only packet path may touch recv_buf_ (deferred replay too).
+    struct receive_wait
+    {
+      coro_block &block;
+      clock::time_point deadline;
+
+      bool await_ready() const noexcept { return block.received_; }
+      void await_suspend(std::coroutine_handle<> h);
+      std::pair<asio::error_code, size_t> await_resume();
+    };
+
+    struct send_wait
+    {
+      coro_block &block;
+      asio::const_buffer buf;
+      const transport::endpoint &destination;
+
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> h);
+      std::pair<asio::error_code, size_t> await_resume() const { return {block.send_error_, block.send_bytes_}; }
+    };
+
+    receive_wait receive_or_timeout(clock::time_point deadline) { return {*this, deadline}; }
+    send_wait async_send(asio::const_buffer buf, const transport::endpoint &destination) { return {*this, buf, destination}; }
+
+    void complete_receive(const asio::error_code &error, size_t bytes_recvd);
+    void complete_wait(const asio::error_code &e);
+    void complete_send(const asio::error_code &error, size_t bytes_sent);
+
+    void lead_slaves();
+
+    bool control_;
+
+    coro_task<void> run_;
+
+    std::coroutine_handle<> receive_waiter_;
+    std::coroutine_handle<> send_waiter_;
+    bool receive_posted_ = {false};
+    bool received_ = {false}; // receive completed while nobody waited
+    clock::time_point timer_deadline_;
+    asio::error_code receive_error_;
+    size_t receive_bytes_ = {0};
+    asio::error_code send_error_;
+    size_t send_bytes_ = {0};
+  };
+
+  inline void
+  coro_block::receive_wait::await_suspend(std::coroutine_handle<> h)
+  {
+    block.receive_waiter_ = h;
+
+    if (!block.receive_posted_)
+    {
+      block.receive_posted_ = true;
+      block.transport_->async_receive_from(asio::buffer(block.recv_buf_, sizeof(block.recv_buf_)), block.sender_endpoint_,
+                                           [b = &block](const asio::error_code &error, size_t bytes_recvd)
+                                           { b->complete_receive(error, bytes_recvd); });
+    }
+
+    // Timer stays armed between waits for the same deadline
+    if (deadline == clock::time_point::max())
+    {
+      block.timer_.cancel();
+    }
+    else if (!block.timer_.armed() || deadline != block.timer_deadline_)
+    {
+      block.timer_deadline_ = deadline;
+      block.timer_.expires_at(deadline, [b = &block](const asio::error_code &e)
+                              { b->complete_wait(e); });
+    }
+  }
+
+  inline std::pair<asio::error_code, size_t>
+  coro_block::receive_wait::await_resume()
+  {
+    block.received_ = false;
+    return {block.receive_error_, block.receive_bytes_};
+  }
+
+  inline void
+  coro_block::send_wait::await_suspend(std::coroutine_handle<> h)
+  {
+    block.send_waiter_ = h;
+    block.transport_->async_send_to(buf, destination, [b = &block](const asio::error_code &error, size_t bytes_sent)
+                                    { b->complete_send(error, bytes_sent); });
+  }
+
+  // Transport and timer completions, the waiting loop goes on from here
+
+  inline void
+  coro_block::complete_receive(const asio::error_code &error, size_t bytes_recvd)
+  {
+    receive_posted_ = false;
+    receive_error_ = error;
+    receive_bytes_ = bytes_recvd;
+
+    if (!receive_waiter_)
+    {
+      // Loop is sending after a timeout, the packet waits for its next wait
+      received_ = true;
+      return;
+    }
+
+    std::exchange(receive_waiter_, {}).resume();
+  }
+
+  inline void
+  coro_block::complete_wait(const asio::error_code &e)
+  {
+    // Deadline passed while the loop was busy: it checks the clock itself
+    if (e == asio::error::operation_aborted || !receive_waiter_)
+    {
+      return;
+    }
+
+    receive_error_ = asio::error::timed_out;
+    receive_bytes_ = 0;
+    std::exchange(receive_waiter_, {}).resume();
+  }
+
+  inline void
+  coro_block::complete_send(const asio::error_code &error, size_t bytes_sent)
+  {
+    send_error_ = error;
+    send_bytes_ = bytes_sent;
+    std::exchange(send_waiter_, {}).resume();
+  }
+
+} // namespace cbp
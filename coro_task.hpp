@@ -0,0 +1,200 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+
+namespace cbp
+{
+  // Frame memory of coroutines of one owner, its base (coro_block): a slot per
+  // frame alive at once, kept when the frame ends and grown only when a bigger frame
+  // comes. So after every coroutine has run once, starting one again does not
+  // touch the heap. Not thread safe, used from the io_context thread only.
+  class coro_frames
+  {
+  public:
+    coro_frames() = default;
+    coro_frames(const coro_frames &) = delete;
+    coro_frames &operator=(const coro_frames &) = delete;
+
+    ~coro_frames()
+    {
+      for (auto &s : slots_)
+      {
+        ::operator delete(s.data);
+      }
+    }
+
+    void *
+    allocate(std::size_t size)
+    {
+      for (auto &s : slots_)
+      {
+        if (!s.in_use)
+        {
+          if (s.size < size)
+          {
+            ::operator delete(s.data);
+            s.data = ::operator new(size);
+            s.size = size;
+          }
+
+          s.in_use = true;
+          return s.data;
+        }
+      }
+
+      return ::operator new(size);
+    }
+
+    void
+    deallocate(void *p)
+    {
+      for (auto &s : slots_)
+      {
+        if (p == s.data)
+        {
+          s.in_use = false;
+          return;
+        }
+      }
+
+      ::operator delete(p);
+    }
+
+  private:
+    // Constants
+    static constexpr int slots = 2; // block coroutine and its current loop
+
+    struct slot
+    {
+      void *data = {nullptr};
+      std::size_t size = {0};
+      bool in_use = {false};
+    };
+
+    slot slots_[slots];
+  };
+
+  // Result of coro_task, none for void
+  template <typename T>
+  struct coro_result
+  {
+    T value;
+
+    void return_value(T v) { value = std::move(v); }
+    T result() { return std::move(value); }
+  };
+
+  template <>
+  struct coro_result<void>
+  {
+    void return_void() {}
+    void result() {}
+  };
+
+  // Lazy coroutine returning T, frame from owner's coro_frames (owner is the
+  // object of member coroutine, derived from coro_frames).
+  // co_await of coro_task starts it and resumes the caller when it returns;
+  // a top level one is started by start() and lives until destroyed.
+  // Exception leaving the coroutine is rethrown to whoever resumed it, for
+  // a block that is the asio handler, i.e. io_context::run().
+  template <typename T>
+  class coro_task
+  {
+  public:
+    struct promise_type : coro_result<T>
+    {
+      std::coroutine_handle<> caller;
+
+      coro_task get_return_object() { return coro_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+
+      auto
+      final_suspend() noexcept
+      {
+        struct to_caller
+        {
+          bool await_ready() noexcept { return false; }
+
+          std::coroutine_handle<>
+          await_suspend(std::coroutine_handle<promise_type> h) noexcept
+          {
+            return h.promise().caller ? h.promise().caller : std::noop_coroutine();
+          }
+
+          void await_resume() noexcept {}
+        };
+
+        return to_caller{};
+      }
+
+      void unhandled_exception() { throw; }
+
+      // Frame is prefixed with its coro_frames, operator delete has no owner.
+      // Non-template, with other arguments of the coroutine (trivially
+      // copyable ones only) through the ellipsis: g++ 12 mistakes a template
+      // operator new for a mismatch of operator delete
+      static void *
+      operator new(std::size_t size, coro_frames &owner, ...)
+      {
+        void *p = owner.allocate(size + prefix);
+        *static_cast<coro_frames **>(p) = &owner;
+        return static_cast<char *>(p) + prefix;
+      }
+
+      static void
+      operator delete(void *p, std::size_t)
+      {
+        void *block = static_cast<char *>(p) - prefix;
+        (*static_cast<coro_frames **>(block))->deallocate(block);
+      }
+    };
+
+    coro_task() = default;
+    coro_task(const coro_task &) = delete;
+    coro_task &operator=(const coro_task &) = delete;
+
+    coro_task(coro_task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+    coro_task &
+    operator=(coro_task &&other) noexcept
+    {
+      std::swap(handle_, other.handle_);
+      return *this;
+    }
+
+    ~coro_task()
+    {
+      if (handle_)
+      {
+        handle_.destroy();
+      }
+    }
+
+    // Top level: run until the first wait
+    void start() { handle_.resume(); }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> caller) noexcept
+    {
+      handle_.promise().caller = caller;
+      return handle_;
+    }
+
+    T await_resume() { return handle_.promise().result(); }
+
+  private:
+    // Constants
+    static constexpr std::size_t prefix = alignof(std::max_align_t);
+
+    explicit coro_task(std::coroutine_handle<promise_type> h) : handle_(h) {}
+
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+} // namespace cbp
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cycle_quorum.hpp"
+
+namespace cbp
+{
+  void
+  cycle_quorum::start()
+  {
+    std::sort(next_.begin(), next_.end());
+    next_.erase(std::unique(next_.begin(), next_.end()), next_.end());
+
+    expected_.swap(next_);
+    next_.clear();
+
+    answered_.assign(expected_.size(), false);
+    count_ = 0;
+    // Nobody expected (first cycle) - wait for timer
+    needed_ = expected_.empty() ? 0 : std::max<size_t>(1, size_t(std::ceil(quorum_ * double(expected_.size()) - 1e-9)));
+    reached_ = false;
+  }
+
+  bool
+  cycle_quorum::answered(uint16_t session)
+  {
+    // Every responder is expected next time, known or new
+    next_.push_back(session);
+
+    auto it = std::lower_bound(expected_.begin(), expected_.end(), session);
+    if (it == expected_.end() || *it != session)
+    {
+      return false;
+    }
+
+    const size_t i = it - expected_.begin();
+    if (answered_[i])
+    {
+      return false;
+    }
+
+    answered_[i] = true;
+
+    if (reached_ || !needed_ || ++count_ < needed_)
+    {
+      return false;
+    }
+
+    reached_ = true;
+    return true;
+  }
+
+} // namespace cbp
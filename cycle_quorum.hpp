@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cbp
+{
+  // Expected responders of a master's get_data cycle (--early-cycle), by
+  // session id (session_registry). Slaves that answered the previous
+  // get_data_req or registered since are expected to answer the current
+  // one; once the quorum of them has
+  // answered the cycle may be closed without waiting for its timer. A slave
+  // that stops answering is expected for one more cycle only, so that cycle
+  // runs to the timer and the next ones close early again.
+  class cycle_quorum
+  {
+  public:
+    // quorum - share of expected slaves, 0 < quorum <= 1
+    explicit cycle_quorum(double quorum) : quorum_(quorum) {}
+
+    // get_data_req sent: responders since previous one become expected
+    void start();
+
+    // Slave registered, it is expected from next get_data_req on
+    void add(uint16_t session) { next_.push_back(session); }
+
+    // get_data_rsp from slave. Returns true once per cycle, when the
+    // quorum is reached
+    bool answered(uint16_t session);
+
+    size_t expected() const { return expected_.size(); }
+    double quorum() const { return quorum_; }
+
+  private:
+    double quorum_;
+
+    std::vector<uint16_t> expected_; // sorted
+    std::vector<bool> answered_;     // by position in expected_
+    size_t count_ = {0};
+    size_t needed_ = {0};
+    bool reached_ = {false};
+
+    std::vector<uint16_t> next_;
+  };
+
+} // namespace cbp
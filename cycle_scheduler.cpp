@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "cycle_scheduler.hpp"
+
+namespace cbp
+{
+  cycle_scheduler::cycle_scheduler(duration min, duration max, duration initial, duration set_data_period)
+      : min_(min),
+        max_(max),
+        interval_(std::clamp(initial, min, max)),
+        set_data_period_(set_data_period)
+  {
+    if (min_.count() <= 0 || min_ > max_ || max_ > max_interval_limit)
+    {
+      throw std::invalid_argument("get_data cycle bounds must be 0 < min <= max <= 15000 ms");
+    }
+
+    set_data_cycles_ = std::max(1, int(set_data_period_ / interval_));
+  }
+
+  bool
+  cycle_scheduler::end_cycle(size_t responses, std::chrono::steady_clock::duration lag)
+  {
+    update_fleet(responses);
+    return tune(fleet_, responses, lag);
+  }
+
+  bool
+  cycle_scheduler::end_cycle(size_t responses, size_t expected, std::chrono::steady_clock::duration lag)
+  {
+    update_fleet(responses);
+    return tune(double(expected), responses, lag);
+  }
+
+  void
+  cycle_scheduler::update_fleet(size_t responses)
+  {
+    // Fleet estimate follows growth at once and shrinks slowly, so a single
+    // bad cycle is reported as loss instead of a smaller fleet
+    fleet_ = (double(responses) >= fleet_) ? double(responses) : 0.875 * fleet_ + 0.125 * double(responses);
+  }
+
+  bool
+  cycle_scheduler::tune(double expected, size_t responses, std::chrono::steady_clock::duration lag)
+  {
+    const double lost = std::max(0.0, expected - double(responses)) + double(drops_);
+    const bool overload = (expected > 0 && lost / expected > max_loss) || lag > max_lag;
+    drops_ = 0;
+
+    const duration target = std::clamp(min_ + std::chrono::duration_cast<duration>(per_slave_cost * fleet_),
+                                       min_, max_);
+    duration next;
+
+    if (overload)
+    {
+      next = std::min(max_, std::max(target, interval_ * 3 / 2));
+    }
+    else if (interval_ - target > duration(10))
+    {
+      // Halfway back per cycle, so a backoff is not undone by one good cycle
+      next = target + (interval_ - target) / 2;
+    }
+    else
+    {
+      next = target;
+    }
+
+    if (next == interval_)
+    {
+      return false;
+    }
+
+    interval_ = next;
+    set_data_cycles_ = std::max(1, int(set_data_period_ / interval_));
+    return true;
+  }
+
+} // namespace cbp
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace cbp
+{
+  // Adaptive get_data cycle of a master.
+  // Target interval grows with fleet size (smoothed responses per cycle), so
+  // small fleets are polled fast and large ones get time to answer. On signs
+  // of overload (lost responses, discarded packets, late cycle timer) the
+  // interval backs off multiplicatively and then creeps back to the target.
+  // set_data cadence follows the interval to keep set_data period constant.
+  class cycle_scheduler
+  {
+  public:
+    using duration = std::chrono::milliseconds;
+
+    // Constants
+    // Slaves give up after 30s without get_data_req, keep a safe margin
+    static constexpr duration max_interval_limit = std::chrono::seconds(15);
+    static constexpr std::chrono::microseconds per_slave_cost = std::chrono::microseconds(100);
+    static constexpr duration max_lag = duration(50);
+    static constexpr double max_loss = 0.05;
+
+    cycle_scheduler(duration min, duration max, duration initial, duration set_data_period);
+
+    // Called at the end of every get_data cycle. Returns true if the interval changed.
+    bool end_cycle(size_t responses, std::chrono::steady_clock::duration lag);
+
+    // Same for a cycle polling one shard of fleet (--shards): responses are
+    // expected as many as that shard gave last time, not as the fleet estimate
+    bool end_cycle(size_t responses, size_t expected, std::chrono::steady_clock::duration lag);
+
+    // Packet lost on the way in: discarded, receive or send error
+    void on_drop() { ++drops_; }
+
+    duration interval() const { return interval_; }
+    int set_data_cycles() const { return set_data_cycles_; }
+    double fleet() const { return fleet_; }
+
+  private:
+    void update_fleet(size_t responses);
+    bool tune(double expected, size_t responses, std::chrono::steady_clock::duration lag);
+
+    duration min_;
+    duration max_;
+    duration interval_;
+    duration set_data_period_;
+    int set_data_cycles_;
+
+    double fleet_ = {0}; // smoothed responses per cycle
+    size_t drops_ = {0};
+  };
+
+} // namespace cbp
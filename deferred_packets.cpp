@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstring>
+
+#include "deferred_packets.hpp"
+
+namespace cbp
+{
+  // Same slot: later packet makes earlier one useless. Whole header is
+  // compared, that is type, mode and sender block, or session and epoch of
+  // session_header (type has session_flag, so the two never match)
+  static bool
+  is_batch(const uint8_t *net_buf)
+  {
+    const packet_header *h = reinterpret_cast<const packet_header *>(net_buf);
+    return ntohs(h->operation) == static_cast<uint16_t>(packet_header::packet_type::set_data_batch);
+  }
+
+  static size_t
+  header_len(const uint8_t *net_buf)
+  {
+    const packet_header *h = reinterpret_cast<const packet_header *>(net_buf);
+    return (ntohs(h->operation) & session_header::session_flag) ? sizeof(session_header) : sizeof(packet_header);
+  }
+
+  static bool
+  same_slot(const uint8_t *a, const uint8_t *b)
+  {
+    const size_t len = header_len(a);
+    if (len != header_len(b) || std::memcmp(a, b, len) != 0)
+    {
+      return false;
+    }
+
+    if (!is_batch(a))
+    {
+      return true;
+    }
+
+    const batch_header *ha = reinterpret_cast<const batch_header *>(a + sizeof(packet_header));
+    const batch_header *hb = reinterpret_cast<const batch_header *>(b + sizeof(packet_header));
+    return ha->frame == hb->frame;
+  }
+
+  // Hash of what same_slot() compares
+  static size_t
+  slot_hash(const uint8_t *net_buf)
+  {
+    uint64_t words[3] = {};
+    std::memcpy(words, net_buf, header_len(net_buf));
+    if (is_batch(net_buf))
+    {
+      words[2] ^= uint64_t(reinterpret_cast<const batch_header *>(net_buf + sizeof(packet_header))->frame) << 32;
+    }
+
+    uint64_t x = words[0] ^ (words[1] * 0x9e3779b97f4a7c15ULL) ^ (words[2] * 0xc2b2ae3d27d4eb4fULL);
+    x ^= x >> 31;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 29;
+    return size_t(x);
+  }
+
+  size_t
+  deferred_packets::find(const uint8_t *net_buf) const
+  {
+    const size_t mask = index_.size() - 1;
+    for (size_t i = slot_hash(net_buf) & mask; index_[i]; i = (i + 1) & mask)
+    {
+      if (same_slot(ring_[index_[i] - 1].data, net_buf))
+      {
+        return index_[i] - 1;
+      }
+    }
+    return ring_.size();
+  }
+
+  void
+  deferred_packets::index(size_t pos)
+  {
+    const size_t mask = index_.size() - 1;
+    size_t i = slot_hash(ring_[pos].data) & mask;
+    while (index_[i])
+    {
+      i = (i + 1) & mask;
+    }
+    index_[i] = uint16_t(pos + 1);
+  }
+
+  // Backward shift: later entries of the probe run move into the hole, so
+  // lookups need no tombstones
+  void
+  deferred_packets::unindex(size_t pos)
+  {
+    const size_t mask = index_.size() - 1;
+    size_t i = slot_hash(ring_[pos].data) & mask;
+    while (index_[i] != pos + 1)
+    {
+      i = (i + 1) & mask;
+    }
+
+    for (size_t j = (i + 1) & mask; index_[j]; j = (j + 1) & mask)
+    {
+      // Entry at j may fill the hole at i unless its home is in (i, j]
+      const size_t home = slot_hash(ring_[index_[j] - 1].data) & mask;
+      if (((j - home) & mask) >= ((j - i) & mask))
+      {
+        index_[i] = index_[j];
+        i = j;
+      }
+    }
+    index_[i] = 0;
+  }
+
+  void
+  deferred_packets::reindex()
+  {
+    std::fill(index_.begin(), index_.end(), 0);
+    for (size_t i = 0; i < count_; ++i)
+    {
+      index(position(i));
+    }
+  }
+
+  // Waiting packets move to the front of the twice bigger ring
+  void
+  deferred_packets::grow()
+  {
+    std::vector<packet> ring(ring_.empty() ? initial_ring : 2 * ring_.size());
+    for (size_t i = 0; i < count_; ++i)
+    {
+      ring[i] = ring_[position(i)];
+    }
+
+    ring_.swap(ring);
+    head_ = 0;
+    index_.assign(2 * ring_.size(), 0);
+    reindex();
+  }
+
+  bool
+  deferred_packets::push(const uint8_t *net_buf, size_t len, const transport::endpoint &from, uint64_t counter,
+                         uint64_t tag, const packet_auth *auth, overload_counters &counters)
+  {
+    size_t pos = ring_.empty() ? 0 : find(net_buf);
+    const bool coalesce = pos < ring_.size();
+
+
+    // Waiting packet is replaced or dropped only for an authentic one
+    if (auth && (coalesce || count_ == capacity) && !auth->verify(net_buf, len, tag))
+    {
+      return false;
+    }
+
+    // Slot comes from one sender: its older (or replayed) packet does not
+    // replace a newer one, unless that one is forged
+    if (auth && coalesce && counter <= ring_[pos].counter)
+    {
+      const packet &w = ring_[pos];
+      if (auth->verify(w.data, w.len, w.tag))
+      {
+        return true;
+      }
+    }
+
+    if (coalesce)
+    {
+      ++counters.coalesced;
+    }
+    else
+    {
+      if (count_ == ring_.size())
+      {
+        if (ring_.size() < capacity)
+        {
+          grow();
+        }
+        else
+        {
+          pop();
+          ++counters.dropped;
+        }
+      }
+
+      pos = position(count_++);
+      ++counters.deferred;
+    }
+
+    packet &p = ring_[pos];
+    p.from = from;
+    p.len = len;
+    p.counter = counter;
+    p.tag = tag;
+    std::memcpy(p.data, net_buf, len + packet_auth::counter_len);
+
+    if (!coalesce)
+    {
+      index(pos);
+    }
+    return true;
+  }
+
+  void
+  deferred_packets::pop()
+  {
+    unindex(head_);
+    head_ = position(1);
+    --count_;
+  }
+
+  size_t
+  deferred_packets::authenticate(const packet_auth &auth)
+  {
+    packet_auth::signed_packet batch[auth_batch];
+    bool ok[auth_batch];
+    size_t kept = 0;
+
+    for (size_t i = 0; i < count_;)
+    {
+      const size_t first = i;
+      size_t n = 0;
+      for (; i < count_ && n < auth_batch; ++i, ++n)
+      {
+        const packet &p = ring_[position(i)];
+        batch[n] = {p.data, p.len, p.tag};
+      }
+
+      auth.verify(batch, n, ok);
+
+      // Packets with a right tag close up behind the kept ones
+      for (size_t k = 0; k < n; ++k)
+      {
+        if (ok[k])
+        {
+          if (kept != first + k)
+          {
+            ring_[position(kept)] = ring_[position(first + k)];
+          }
+          ++kept;
+        }
+      }
+    }
+
+    const size_t failed = count_ - kept;
+    if (failed)
+    {
+      count_ = kept;
+      reindex();
+    }
+
+    return failed;
+  }
+
+} // namespace cbp
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cbp_base.hpp"
+#include "packet_auth.hpp"
+#include "transport.hpp"
+
+namespace cbp
+{
+  // Packets shed or delayed by overload protection, shown by --status
+  struct overload_counters
+  {
+    uint64_t deferred = {0};  // data packets handled after later control ones
+    uint64_t coalesced = {0}; // replaced by newer one of the same slot
+    uint64_t dropped = {0};   // oldest data packet, queue was full
+    uint64_t throttled = {0}; // discovery multicasts over --discovery rate, session_assign over queue
+  };
+
+  // Data packets (get_data_rsp, set_data, set_data_batch) put aside while a
+  // block falls behind, that is more datagrams wait in its transport.
+  // Election and discovery packets are handled on arrival meanwhile, data
+  // ones when the transport is drained. A newer packet of the same slot
+  // (type, sender block or session, batch frame) replaces a waiting one;
+  // when full the oldest one is dropped. With --auth packets wait with their
+  // tags unchecked and are checked together before handling; a packet that
+  // would replace or push out a waiting one is checked first, so a forged
+  // one can't, and newer is told by the sender's counter.
+  // Packets wait in a ring, found by slot through an open addressing index of
+  // ring positions. The ring doubles up to capacity and is kept, so steady
+  // deferring does not allocate and push() does not scan the queue.
+  class deferred_packets
+  {
+  public:
+    struct packet
+    {
+      transport::endpoint from;
+      uint16_t len;
+      uint64_t counter; // --auth, checked on replay
+      uint64_t tag;     // --auth, not checked yet
+      uint8_t data[max_packet_len + packet_auth::counter_len]; // counter follows packet, it is signed too
+    };
+
+    static bool
+    is_data(packet_header::packet_type pt)
+    {
+      return pt == packet_header::packet_type::get_data_rsp ||
+             pt == packet_header::packet_type::set_data ||
+             pt == packet_header::packet_type::set_data_batch;
+    }
+
+    // Valid packet of len bytes in net_buf (--auth: followed by counter),
+    // auth is set if its tag is not checked yet. False if it was checked and
+    // the tag is wrong. --auth: a packet older (by counter) than the one
+    // waiting in its slot is not put aside
+    bool push(const uint8_t *net_buf, size_t len, const transport::endpoint &from, uint64_t counter,
+              uint64_t tag, const packet_auth *auth, overload_counters &counters);
+
+    // --auth: checks tags of all waiting packets in batches, drops packets
+    // with a wrong one and returns their number
+    size_t authenticate(const packet_auth &auth);
+
+    bool empty() const { return count_ == 0; }
+    const packet &front() const { return ring_[head_]; }
+    void pop();
+
+    // Constants
+    static constexpr size_t capacity = 1024;
+    static constexpr size_t auth_batch = 64;
+    static constexpr size_t initial_ring = 16;
+
+    static_assert((capacity & (capacity - 1)) == 0 && capacity < 0x10000);
+
+  private:
+    size_t position(size_t i) const { return (head_ + i) & (ring_.size() - 1); }
+    size_t find(const uint8_t *net_buf) const;
+    void index(size_t pos);
+    void unindex(size_t pos);
+    void reindex();
+    void grow();
+
+    std::vector<packet> ring_;    // power of two packets
+    std::vector<uint16_t> index_; // ring position + 1, 0 is free, twice the ring
+    size_t head_ = {0};
+    size_t count_ = {0};
+  };
+
+} // namespace cbp
@@ -0,0 +1,95 @@
+#include <cstring>
+
+#include "display_batch.hpp"
+
+namespace cbp
+{
+  size_t
+  display_batch::encode(const packet_templates &templates, packet_header::block_mode mode,
+                        const display_data &shared, const std::vector<display_record> &records)
+  {
+    const size_t frames = (records.size() + records_per_frame - 1) / records_per_frame;
+
+    frames_.resize(frames * max_batch_len);
+    lens_.resize(frames);
+
+    for (size_t f = 0; f < frames; ++f)
+    {
+      uint8_t *buf = frames_.data() + f * max_batch_len;
+      const size_t first = f * records_per_frame;
+      const size_t count = std::min(records_per_frame, records.size() - first);
+
+      templates.to_netbuf(buf, packet_header::packet_type::set_data_batch, mode);
+
+      batch_header h;
+      h.count = htons(count);
+      h.frame = htons(f);
+      h.frames = htons(frames);
+      std::memcpy(buf + sizeof(packet_header), &h, sizeof(h));
+
+      uint8_t *p = buf + sizeof(packet_header) + sizeof(batch_header);
+      std::memcpy(p, shared.text, display_txt_len);
+      std::memcpy(p + display_txt_len, shared.temperature, temperature_len);
+      std::memcpy(p + display_txt_len + temperature_len, shared.time, display_time_len);
+
+      p = buf + batch_fixed_len;
+      for (size_t i = 0; i < count; ++i, p += sizeof(display_record))
+      {
+        display_record r = records[first + i];
+        r.id = htonl(r.id);
+        r.brightness = htons(r.brightness);
+        std::memcpy(p, &r, sizeof(r));
+      }
+
+      lens_[f] = batch_fixed_len + count * sizeof(display_record);
+    }
+
+    return frames;
+  }
+
+  bool
+  display_batch::find(const uint8_t *net_buf, uint32_t id, display_record &r)
+  {
+    batch_header h;
+    std::memcpy(&h, net_buf + sizeof(packet_header), sizeof(h));
+
+    // Records may be unaligned in receive buffer, read by copy
+    const uint8_t *records = net_buf + batch_fixed_len;
+    size_t lo = 0, hi = ntohs(h.count);
+
+    while (lo < hi)
+    {
+      const size_t mid = (lo + hi) / 2;
+      std::memcpy(&r, records + mid * sizeof(display_record), sizeof(r));
+
+      const uint32_t mid_id = ntohl(r.id);
+      if (mid_id == id)
+      {
+        r.id = mid_id;
+        r.brightness = ntohs(r.brightness);
+        return true;
+      }
+
+      if (mid_id < id)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+
+    return false;
+  }
+
+  void
+  display_batch::shared_from_netbuf(const uint8_t *net_buf, display_data &d)
+  {
+    const uint8_t *p = net_buf + sizeof(packet_header) + sizeof(batch_header);
+    std::memcpy(d.text, p, display_txt_len);
+    std::memcpy(d.temperature, p + display_txt_len, temperature_len);
+    std::memcpy(d.time, p + display_txt_len + temperature_len, display_time_len);
+  }
+
+} // namespace cbp
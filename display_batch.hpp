@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cbp_base.hpp"
+
+namespace cbp
+{
+  // set_data_batch frames (master with --per-slave): display data of every
+  // slave, records_per_frame per multicast frame. Text, temperature and time
+  // are shared and repeated in every frame, so each frame stands alone.
+  // Records are sorted by id, a slave finds its own one by binary search.
+  class display_batch
+  {
+  public:
+    // Encodes records (sorted by id) into frames, one after another
+    // max_batch_len apart in frames_. Returns number of frames
+    size_t encode(const packet_templates &templates, packet_header::block_mode mode,
+                  const display_data &shared, const std::vector<display_record> &records);
+
+    const uint8_t *frame(size_t i) const { return frames_.data() + i * max_batch_len; }
+    size_t frame_len(size_t i) const { return lens_[i]; }
+
+    // Record of slave with given id in received frame, which is valid
+    // (packet_header::is_packet_valid)
+    static bool find(const uint8_t *net_buf, uint32_t id, display_record &r);
+
+    // Shared part of received frame, brightness is left as is
+    static void shared_from_netbuf(const uint8_t *net_buf, display_data &d);
+
+  private:
+    std::vector<uint8_t> frames_;
+    std::vector<size_t> lens_;
+  };
+
+} // namespace cbp
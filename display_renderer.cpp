@@ -0,0 +1,92 @@
+#include <iostream>
+#include <sstream>
+
+#include "display_renderer.hpp"
+
+namespace cbp
+{
+  display_renderer::display_renderer(unsigned fps)
+      : period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / fps),
+        thread_([this]
+                { run(); })
+  {
+  }
+
+  display_renderer::~display_renderer()
+  {
+    stop_.store(true);
+    posted_.fetch_add(1, std::memory_order_release);
+    posted_.notify_one();
+    thread_.join();
+  }
+
+  void
+  display_renderer::post(const display_data &net_data)
+  {
+    const uint64_t seq = posted_.load(std::memory_order_relaxed) + 1;
+    frame_.store({net_data, std::chrono::steady_clock::now(), seq});
+
+    posted_.store(seq, std::memory_order_release);
+    posted_.notify_one();
+  }
+
+  void
+  display_renderer::draw(std::ostream &os, const display_data &net_data)
+  {
+    os << "Displayed: Time["
+       << net_data.time
+       << "] Info["
+       << net_data.text
+       << "] Temperature["
+       << net_data.temperature
+       << "] Brightness["
+       << ntohs(net_data.brightness) // from net to host
+       << "]" << std::endl;
+  }
+
+  void
+  display_renderer::run()
+  {
+    using clock = std::chrono::steady_clock;
+
+    uint64_t drawn = 0;
+    clock::time_point next = clock::now();
+    clock::time_point print_at = next + print_period;
+
+    for (;;)
+    {
+      posted_.wait(drawn, std::memory_order_acquire);
+      if (stop_.load())
+      {
+        return;
+      }
+
+      // Frame cap: frames posted meanwhile replace this one
+      std::this_thread::sleep_until(next);
+
+      const frame f = frame_.load();
+      skipped_.fetch_add(f.seq - drawn - 1, std::memory_order_relaxed);
+      drawn = f.seq;
+
+      // Whole line at once, protocol thread prints too
+      std::ostringstream os;
+      draw(os, f.data);
+      std::cout << os.str() << std::flush;
+
+      const clock::time_point now = clock::now();
+      latency_.record(now - f.posted);
+      rendered_.fetch_add(1, std::memory_order_relaxed);
+      next = now + period_;
+
+      if (now >= print_at)
+      {
+        std::ostringstream latency;
+        latency << "Render ";
+        latency_.print(latency);
+        std::cout << latency.str() << std::flush;
+        print_at = now + print_period;
+      }
+    }
+  }
+
+} // namespace cbp
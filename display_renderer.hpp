@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <thread>
+
+#include "busy_poll.hpp"
+#include "cbp_base.hpp"
+#include "seqlock.hpp"
+
+namespace cbp
+{
+  // Display of a slave on its own thread (--render=<fps>). The protocol
+  // thread only stores the newest display_data into a seqlock, so a slow
+  // display never holds up get_data_rsp. The render thread draws at most
+  // fps frames a second and always the newest one; frames replaced before
+  // they were drawn are skipped. Post-to-drawn latency is printed every
+  // print_period.
+  class display_renderer
+  {
+  public:
+    explicit display_renderer(unsigned fps);
+    ~display_renderer();
+
+    display_renderer(const display_renderer &) = delete;
+    display_renderer &operator=(const display_renderer &) = delete;
+
+    // Protocol thread, never blocks. Brightness in net order, as received
+    void post(const display_data &net_data);
+
+    uint64_t rendered() const { return rendered_.load(std::memory_order_relaxed); }
+    uint64_t skipped() const { return skipped_.load(std::memory_order_relaxed); }
+
+    // What the display driver does with a frame: one line on os
+    static void draw(std::ostream &os, const display_data &net_data);
+
+    // Constants
+    static constexpr unsigned max_fps = 1000;
+    static constexpr std::chrono::seconds print_period = std::chrono::seconds(10);
+
+  private:
+    struct frame
+    {
+      display_data data;
+      std::chrono::steady_clock::time_point posted;
+      uint64_t seq;
+    };
+
+    void run();
+
+    std::chrono::steady_clock::duration period_;
+    seqlock<frame> frame_;
+    std::atomic<uint64_t> posted_ = {0}; // seq of newest frame, render thread waits on it
+    std::atomic<bool> stop_ = {false};
+
+    std::atomic<uint64_t> rendered_ = {0};
+    std::atomic<uint64_t> skipped_ = {0};
+    latency_histogram latency_; // render thread only
+
+    std::thread thread_;
+  };
+
+} // namespace cbp
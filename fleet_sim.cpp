@@ -0,0 +1,206 @@
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "client_block.hpp"
+#include "loopback_transport.hpp"
+
+#ifdef CBP_COROUTINE_ENGINE
+#include "coro_block.hpp"
+#endif
+
+// Whole fleet in one process over loopback_network (optionally impaired with
+// --loss): control blocks and indication blocks run their real handlers and
+// timers. Time is virtual (block_clock): all packets of an instant are
+// handled, then time jumps to the next timer, so seconds of the run are
+// protocol time, taking only the CPU time its packets need, and the result
+// does not depend on machine speed or load. After the run election and
+// aggregation are checked: one master (the control block if there is one),
+// all others slaves, master's fleet estimate covers every slave. The estimate
+// needs a couple of get_data cycles (the first one is 5s), so runs shorter
+// than 10 seconds fail aggregation.
+// With --engine=coro (CORO=1 build) every block runs the coroutine engine,
+// packets/cpu_s of the same workload compares the engines per packet.
+
+int
+main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: fleet_sim <control_blocks> <client_blocks> [seconds] [options]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    fleet_sim 1 200 30 --loss=1:2:1\n";
+    std::cerr << "  More than one control block ends with exit() by protocol design\n";
+    cbp::block_options::print_usage(std::cerr);
+    return 1;
+  }
+
+  try
+  {
+    const unsigned control_blocks = std::strtoul(argv[1], nullptr, 10);
+    const unsigned client_blocks = std::strtoul(argv[2], nullptr, 10);
+    const bool has_seconds = (argc > 3 && argv[3][0] != '-');
+    const long seconds = has_seconds ? std::strtol(argv[3], nullptr, 10) : 30;
+    cbp::block_options options = cbp::block_options::parse(argc, argv, has_seconds ? 4 : 3);
+
+#ifdef CBP_TRACE
+    // Whole fleet on one timeline, a row per block
+    if (!options.trace_path.empty())
+    {
+      cbp::trace::start(options.trace_path);
+    }
+#endif
+
+    // Timers of blocks created from now on run on virtual time
+    cbp::block_clock::start_virtual();
+
+    asio::io_context io_context;
+    cbp::loopback_network network(io_context);
+    const auto multicast_address = asio::ip::make_address("239.255.0.1");
+
+    std::vector<std::unique_ptr<cbp::control_block>> blocks;
+
+    for (unsigned i = 0; i < control_blocks + client_blocks; ++i)
+    {
+      // Same ids and losses on every run
+      options.id_seed = i + 1;
+      auto t = cbp::transport::impair(io_context, std::make_unique<cbp::loopback_transport>(network), options, i + 1);
+
+#ifdef CBP_COROUTINE_ENGINE
+      if (options.coro_engine)
+      {
+        blocks.push_back(std::make_unique<cbp::coro_block>(io_context, std::move(t), multicast_address, options,
+                                                           i < control_blocks));
+        continue;
+      }
+#endif
+
+      if (i < control_blocks)
+      {
+        blocks.push_back(std::make_unique<cbp::control_block>(io_context, std::move(t), multicast_address, options));
+      }
+      else
+      {
+        blocks.push_back(std::make_unique<cbp::client_block>(io_context, std::move(t), multicast_address, options));
+      }
+    }
+
+    // Blocks log every packet, keep only the summary
+    auto *out = std::cout.rdbuf(nullptr);
+
+    const std::clock_t cpu_start = std::clock();
+    for (auto &b : blocks)
+    {
+      b->start();
+    }
+
+    // Everything due at this instant, then the next timer
+    const auto end = cbp::block_clock::now() + std::chrono::seconds(seconds);
+    auto &wheel = asio::use_service<cbp::timer_wheel>(io_context);
+    for (;;)
+    {
+      io_context.restart();
+      io_context.poll();
+
+      cbp::block_clock::time_point next;
+      if (!wheel.next_tick(next) || next > end)
+      {
+        break;
+      }
+
+      cbp::block_clock::advance_to(next);
+      wheel.run_tick();
+    }
+    const double cpu = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    std::cout.rdbuf(out);
+    std::cout.clear();
+
+#ifdef CBP_TRACE
+    cbp::trace::write();
+#endif
+
+    unsigned masters = 0, slaves = 0;
+    const cbp::control_block *master = nullptr;
+    std::map<std::string, unsigned> states;
+
+    for (auto &b : blocks)
+    {
+      ++states[b->state_name()];
+
+      if (b->is_master())
+      {
+        ++masters;
+        master = b.get();
+      }
+      else if (auto *c = dynamic_cast<const cbp::client_block *>(b.get()); c && c->is_slave())
+      {
+        ++slaves;
+      }
+    }
+
+    std::cout << "blocks=" << blocks.size()
+              << " seconds=" << seconds
+              << " delivered=" << network.delivered()
+              << " dropped=" << network.dropped()
+              << " packets/s=" << double(network.delivered()) / double(seconds)
+              << " packets/cpu_s=" << double(network.delivered()) / cpu
+              << std::endl;
+
+    for (const auto &[name, n] : states)
+    {
+      std::cout << name << "=" << n << " ";
+    }
+    std::cout << std::endl;
+
+    std::cout << "masters=" << masters
+              << " slaves=" << slaves
+              << " master_fleet=" << (master ? master->fleet() : 0)
+              << std::endl;
+
+    // Overload protection and --auth drops, summed over all blocks
+    cbp::overload_counters overload;
+    uint64_t auth_failed = 0;
+    for (auto &b : blocks)
+    {
+      auth_failed += b->auth_failed();
+      overload.deferred += b->overload().deferred;
+      overload.coalesced += b->overload().coalesced;
+      overload.dropped += b->overload().dropped;
+      overload.throttled += b->overload().throttled;
+    }
+
+    std::cout << "deferred=" << overload.deferred
+              << " coalesced=" << overload.coalesced
+              << " dropped=" << overload.dropped
+              << " throttled=" << overload.throttled
+              << " auth_failed=" << auth_failed
+              << std::endl;
+
+    const bool elected = (masters == 1) && (slaves + 1 == blocks.size()) &&
+                         (!control_blocks || master == blocks.front().get());
+    const bool aggregated = master && master->fleet() >= 0.9 * double(slaves);
+
+    std::cout << "election " << (elected ? "ok" : "FAILED")
+              << ", aggregation " << (aggregated ? "ok" : "FAILED")
+              << std::endl;
+
+    if (master && !master->fleet())
+    {
+      std::cout << "No get_data cycle closed in " << seconds << " seconds, run longer" << std::endl;
+    }
+
+    return (elected && aggregated) ? 0 : 1;
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+}
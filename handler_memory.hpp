@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace cbp
+{
+  // Small fixed arena for asio handler allocations (see asio "allocation" example).
+  // A block has only a few operations in flight (one receive, a couple of sends,
+  // timer wait plus a cancelled one), so after start up no handler touches the heap.
+  // Falls back to the heap if all slots are busy or a handler is too big.
+  // Not thread safe, used from the io_context thread only.
+  class handler_memory
+  {
+  public:
+    handler_memory() = default;
+    handler_memory(const handler_memory &) = delete;
+    handler_memory &operator=(const handler_memory &) = delete;
+
+    void *
+    allocate(std::size_t size)
+    {
+      if (size <= slot_size)
+      {
+        for (int i = 0; i < slots; ++i)
+        {
+          if (!in_use_[i])
+          {
+            in_use_[i] = true;
+            return &storage_[i];
+          }
+        }
+      }
+
+      return ::operator new(size);
+    }
+
+    void
+    deallocate(void *p)
+    {
+      for (int i = 0; i < slots; ++i)
+      {
+        if (p == &storage_[i])
+        {
+          in_use_[i] = false;
+          return;
+        }
+      }
+
+      ::operator delete(p);
+    }
+
+  private:
+    // Constants
+    static constexpr int slots = 8;
+    static constexpr std::size_t slot_size = 256;
+
+    struct alignas(std::max_align_t) slot
+    {
+      unsigned char bytes[slot_size];
+    };
+
+    slot storage_[slots];
+    bool in_use_[slots] = {false};
+  };
+
+  // Minimal allocator routing asio allocations to handler_memory
+  template <typename T>
+  class handler_allocator
+  {
+  public:
+    using value_type = T;
+
+    explicit handler_allocator(handler_memory &mem) : memory_(mem) {}
+
+    template <typename U>
+    handler_allocator(const handler_allocator<U> &other) noexcept : memory_(other.memory_) {}
+
+    bool operator==(const handler_allocator &other) const noexcept { return &memory_ == &other.memory_; }
+    bool operator!=(const handler_allocator &other) const noexcept { return &memory_ != &other.memory_; }
+
+    T *allocate(std::size_t n) const { return static_cast<T *>(memory_.allocate(sizeof(T) * n)); }
+    void deallocate(T *p, std::size_t /*n*/) const { memory_.deallocate(p); }
+
+  private:
+    template <typename>
+    friend class handler_allocator;
+
+    handler_memory &memory_;
+  };
+
+  // Handler wrapper with associated allocator, picked up by asio for the operation
+  template <typename Handler>
+  class custom_alloc_handler
+  {
+  public:
+    using allocator_type = handler_allocator<Handler>;
+
+    custom_alloc_handler(handler_memory &m, Handler h) : memory_(m), handler_(std::move(h)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(memory_); }
+
+    template <typename... Args>
+    void operator()(Args &&...args)
+    {
+      handler_(std::forward<Args>(args)...);
+    }
+
+  private:
+    handler_memory &memory_;
+    Handler handler_;
+  };
+
+  template <typename Handler>
+  inline custom_alloc_handler<Handler>
+  make_custom_alloc_handler(handler_memory &m, Handler h)
+  {
+    return custom_alloc_handler<Handler>(m, std::move(h));
+  }
+
+} // namespace cbp
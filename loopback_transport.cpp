@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cstring>
+
+#include "loopback_transport.hpp"
+
+namespace cbp
+{
+  // Constants
+  static constexpr uint32_t first_address = 0x0a000001; // 10.0.0.1
+
+  loopback_network::endpoint
+  loopback_network::join(loopback_transport *t)
+  {
+    members_.push_back(t);
+    return endpoint(asio::ip::address_v4(first_address + members_.size() - 1), multicast_port);
+  }
+
+  void
+  loopback_network::leave(loopback_transport *t)
+  {
+    // Addresses are never reused
+    std::replace(members_.begin(), members_.end(), t, static_cast<loopback_transport *>(nullptr));
+  }
+
+  void
+  loopback_network::send(const endpoint &from, asio::const_buffer buf, const endpoint &to)
+  {
+    if (to.address().is_multicast())
+    {
+      for (loopback_transport *m : members_)
+      {
+        if (m && m->deliver(from, buf))
+        {
+          ++delivered_;
+        }
+        else if (m)
+        {
+          ++dropped_;
+        }
+      }
+      return;
+    }
+
+    const uint64_t i = to.address().is_v4() ? uint64_t(to.address().to_v4().to_uint()) - first_address : members_.size();
+    if (i < members_.size() && members_[i] && members_[i]->deliver(from, buf))
+    {
+      ++delivered_;
+    }
+    else
+    {
+      ++dropped_;
+    }
+  }
+
+  loopback_transport::loopback_transport(loopback_network &network)
+      : network_(network),
+        local_(network.join(this)),
+        inbox_(inbox_size)
+  {
+  }
+
+  loopback_transport::~loopback_transport()
+  {
+    network_.leave(this);
+  }
+
+  void
+  loopback_transport::async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h)
+  {
+    receive_handler_ = std::move(h);
+    receive_buf_ = buf;
+    receive_sender_ = &sender;
+
+    if (count_)
+    {
+      const datagram &d = inbox_[head_];
+      head_ = (head_ + 1) % inbox_size;
+      --count_;
+
+      complete_receive(d.from, d.data, d.len);
+    }
+  }
+
+  void
+  loopback_transport::async_send_to(asio::const_buffer buf, const endpoint &destination, handler h)
+  {
+    network_.send(local_, buf, destination);
+
+    asio::post(network_.context(), make_custom_alloc_handler(memory_, [h = std::move(h), n = buf.size()]
+                                                             { h(asio::error_code(), n); }));
+  }
+
+  void
+  loopback_transport::cancel_receive()
+  {
+    if (receive_handler_)
+    {
+      asio::post(network_.context(), make_custom_alloc_handler(memory_, [h = std::move(receive_handler_)]
+                                                               { h(asio::error::operation_aborted, 0); }));
+      receive_handler_ = nullptr;
+    }
+  }
+
+  bool
+  loopback_transport::deliver(const endpoint &from, asio::const_buffer buf)
+  {
+    if (receive_handler_)
+    {
+      complete_receive(from, buf.data(), buf.size());
+      return true;
+    }
+
+    if (count_ == inbox_size)
+    {
+      return false;
+    }
+
+    datagram &d = inbox_[(head_ + count_++) % inbox_size];
+    d.from = from;
+    d.len = std::min(buf.size(), sizeof(d.data));
+    std::memcpy(d.data, buf.data(), d.len);
+    return true;
+  }
+
+  void
+  loopback_transport::complete_receive(const endpoint &from, const void *data, size_t len)
+  {
+    // Datagram longer than buffer is truncated, as recvfrom does
+    const size_t n = std::min(len, receive_buf_.size());
+    std::memcpy(receive_buf_.data(), data, n);
+    *receive_sender_ = from;
+
+    asio::post(network_.context(), make_custom_alloc_handler(memory_, [h = std::move(receive_handler_), n]
+                                                             { h(asio::error_code(), n); }));
+    receive_handler_ = nullptr;
+  }
+
+} // namespace cbp
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cbp_base.hpp"
+#include "transport.hpp"
+
+namespace cbp
+{
+  class loopback_transport;
+
+  // In-process network of blocks sharing one io_context (fleet_sim).
+  // Members are addressed as 10.x.y.z:30001. A datagram to a multicast
+  // address is copied to every member including the sender (like UDP with
+  // multicast loop), unicast to one member. Nothing leaves the process.
+  class loopback_network
+  {
+  public:
+    using endpoint = transport::endpoint;
+
+    explicit loopback_network(asio::io_context &io_context) : io_context_(io_context) {}
+
+    asio::io_context &context() { return io_context_; }
+
+    endpoint join(loopback_transport *t);
+    void leave(loopback_transport *t);
+
+    void send(const endpoint &from, asio::const_buffer buf, const endpoint &to);
+
+    uint64_t delivered() const { return delivered_; }
+    uint64_t dropped() const { return dropped_; }
+
+  private:
+    asio::io_context &io_context_;
+    std::vector<loopback_transport *> members_; // by address - first address
+
+    uint64_t delivered_ = {0};
+    uint64_t dropped_ = {0};
+
+    friend class loopback_transport;
+  };
+
+  // Member of loopback_network. Received datagrams wait in a bounded inbox
+  // (dropped when full, like a socket buffer), completions are posted to the
+  // io_context, so handlers never run inside send. They are allocated from
+  // the arena of the transport, like socket operations of udp_transport.
+  class loopback_transport : public transport
+  {
+  public:
+    explicit loopback_transport(loopback_network &network);
+    ~loopback_transport() override;
+
+    void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override;
+    void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override;
+    void cancel_receive() override;
+
+    void set_busy_poll(std::chrono::microseconds) override {}
+    void poll_fds(std::vector<int> &) override {}
+    bool backlog() override { return count_ > 0; }
+
+    const endpoint &local_endpoint() const { return local_; }
+
+    // Constants
+    static constexpr unsigned inbox_size = 256;
+
+  private:
+    struct datagram
+    {
+      endpoint from;
+      uint16_t len;
+      uint8_t data[max_datagram_len];
+    };
+
+    // Network side: hand datagram to pending receive or queue it
+    bool deliver(const endpoint &from, asio::const_buffer buf);
+    void complete_receive(const endpoint &from, const void *data, size_t len);
+
+    loopback_network &network_;
+    endpoint local_;
+    handler_memory memory_;
+
+    std::vector<datagram> inbox_;
+    unsigned head_ = {0};
+    unsigned count_ = {0};
+
+    // Outstanding receive
+    handler receive_handler_;
+    asio::mutable_buffer receive_buf_;
+    endpoint *receive_sender_ = {nullptr};
+
+    friend class loopback_network;
+  };
+
+} // namespace cbp
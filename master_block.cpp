@@ -1,27 +1,82 @@
 #include "control_block.hpp"
 
+#ifdef CBP_COROUTINE_ENGINE
+#include "coro_block.hpp"
+#endif
+
+// Blocking event loop, or pinned busy polling one (--busy-poll)
+static void
+run(asio::io_context &io_context, cbp::control_block &cb, const cbp::block_options &options)
+{
+  // Ctrl-C ends the loop, so the block is closed (shm segment unlinked)
+  // and the trace is written (--trace)
+  asio::signal_set signals(io_context, SIGINT, SIGTERM);
+  signals.async_wait([&](const asio::error_code &, int)
+                     { io_context.stop(); });
+
+  if (options.busy_poll_cpu < 0)
+  {
+    io_context.run();
+  }
+  else
+  {
+    cbp::pin_to_cpu(options.busy_poll_cpu);
+    cbp::run_busy_poll(io_context, cb.prepare_busy_poll(options.busy_poll_spin), options.busy_poll_spin);
+  }
+
+#ifdef CBP_TRACE
+  cbp::trace::write();
+#endif
+}
+
 int main(int argc, char *argv[])
 {
   try
   {
-    if (argc != 3)
+    if (argc < 3)
     {
-      std::cerr << "Usage: control_block <listen_address> <multicast_address>\n";
+      std::cerr << "Usage: control_block <listen_address> <multicast_address> [options]\n";
       std::cerr << "  For IPv4, try:\n";
       std::cerr << "    control_block 0.0.0.0 239.255.0.1\n";
       std::cerr << "  For IPv6, try:\n";
       std::cerr << "    control_block 0::0 ff31::8000:1234\n";
+      cbp::block_options::print_usage(std::cerr);
       return 1;
     }
 
+    cbp::block_options options = cbp::block_options::parse(argc, argv, 3);
+
+#ifdef CBP_TRACE
+    if (!options.trace_path.empty())
+    {
+      cbp::trace::start(options.trace_path);
+    }
+#endif
+
     asio::io_context io_context;
 
+#ifdef CBP_COROUTINE_ENGINE
+    if (options.coro_engine)
+    {
+      cbp::coro_block cb(io_context,
+                         asio::ip::make_address(argv[1]),
+                         asio::ip::make_address(argv[2]),
+                         options,
+                         true);
+      cb.start();
+
+      run(io_context, cb, options);
+      return 0;
+    }
+#endif
+
     cbp::control_block cb(io_context,
                           asio::ip::make_address(argv[1]),
-                          asio::ip::make_address(argv[2]));
+                          asio::ip::make_address(argv[2]),
+                          options);
     cb.start();
 
-    io_context.run();
+    run(io_context, cb, options);
   }
   catch (std::exception &e)
   {
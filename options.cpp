@@ -0,0 +1,248 @@
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "options.hpp"
+
+namespace cbp
+{
+  block_options
+  block_options::parse(int argc, char *argv[], int first)
+  {
+    block_options o;
+
+    for (int i = first; i < argc; ++i)
+    {
+      std::string arg(argv[i]);
+      std::string name = arg.substr(0, arg.find('='));
+      std::string value = (name.size() < arg.size()) ? arg.substr(name.size() + 1) : "";
+
+      if (name == "--shm" && !value.empty())
+      {
+        o.shm_name = value;
+      }
+      else if (name == "--shm-only")
+      {
+        o.shm_only = true;
+      }
+      else if (name == "--state" && !value.empty())
+      {
+        o.state_path = value;
+      }
+      else if (name == "--cycle" && value.find(':') != std::string::npos)
+      {
+        // --cycle=<min_ms>:<max_ms>, checked by cycle_scheduler
+        o.cycle_min = std::chrono::milliseconds(std::stol(value.substr(0, value.find(':'))));
+        o.cycle_max = std::chrono::milliseconds(std::stol(value.substr(value.find(':') + 1)));
+      }
+      else if (name == "--early-cycle")
+      {
+        // --early-cycle[=<percent>], all expected slaves by default
+        o.early_cycle = value.empty() ? 1 : std::stod(value) / 100;
+      }
+      else if (name == "--push" && value.find(':') != std::string::npos)
+      {
+        // --push=<temperature>:<brightness>[:<min_ms>[:<keepalive_s>]]
+        size_t first = value.find(':');
+        size_t second = value.find(':', first + 1);
+        size_t third = (second == std::string::npos) ? second : value.find(':', second + 1);
+
+        o.push = true;
+        o.push_temperature = std::stoi(value.substr(0, first));
+        o.push_brightness = std::stoi(value.substr(first + 1, second - first - 1));
+        if (second != std::string::npos)
+        {
+          o.push_min = std::chrono::milliseconds(std::stol(value.substr(second + 1, third - second - 1)));
+        }
+        if (third != std::string::npos)
+        {
+          o.push_keepalive = std::chrono::seconds(std::stol(value.substr(third + 1)));
+        }
+      }
+      else if (name == "--per-slave")
+      {
+        o.per_slave = true;
+      }
+      else if (name == "--shards" && !value.empty())
+      {
+        o.shards = std::stoul(value);
+      }
+      else if (name == "--discovery" && !value.empty())
+      {
+        // --discovery=<per_s>[:<burst>]
+        o.discovery_rate = std::stod(value.substr(0, value.find(':')));
+        if (value.find(':') != std::string::npos)
+        {
+          o.discovery_burst = std::stoul(value.substr(value.find(':') + 1));
+        }
+      }
+      else if (name == "--auth" && !value.empty())
+      {
+        // --auth=<key_file>, key is 32 hex digits
+        std::ifstream f(value);
+        std::string key;
+        if (!(f >> key) || key.size() != 2 * o.auth_key.size() ||
+            key.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+        {
+          throw std::invalid_argument("--auth needs file with 128-bit key in 32 hex digits");
+        }
+
+        for (size_t k = 0; k < o.auth_key.size(); ++k)
+        {
+          o.auth_key[k] = uint8_t(std::stoul(key.substr(2 * k, 2), nullptr, 16));
+        }
+        o.auth = true;
+      }
+      else if (name == "--sample" && !value.empty())
+      {
+        // --sample=<hz>
+        o.sample_rate = std::stoul(value);
+      }
+      else if (name == "--render")
+      {
+        // --render[=<fps>], 30 by default
+        o.render_fps = value.empty() ? 30 : std::stoul(value);
+        if (!o.render_fps)
+        {
+          throw std::invalid_argument("--render needs positive fps");
+        }
+      }
+      else if (name == "--busy-poll" && !value.empty())
+      {
+        // --busy-poll=<cpu>[:<spin_us>]
+        o.busy_poll_cpu = std::stoi(value.substr(0, value.find(':')));
+        if (value.find(':') != std::string::npos)
+        {
+          o.busy_poll_spin = std::chrono::microseconds(std::stol(value.substr(value.find(':') + 1)));
+        }
+      }
+      else if (name == "--latency")
+      {
+        o.latency = true;
+      }
+      else if (name == "--series" && !value.empty())
+      {
+        o.series_dir = value;
+      }
+      else if (name == "--series-raw")
+      {
+        o.series_raw = true;
+      }
+      else if (name == "--status" && !value.empty())
+      {
+        o.status_path = value;
+      }
+      else if (name == "--loss" && !value.empty())
+      {
+        // --loss=<percent>[:<delay_ms>[:<jitter_ms>]]
+        size_t first = value.find(':');
+        size_t second = (first == std::string::npos) ? first : value.find(':', first + 1);
+
+        o.loss = std::stod(value.substr(0, first)) / 100;
+        if (first != std::string::npos)
+        {
+          o.delay = std::chrono::microseconds(long(1000 * std::stod(value.substr(first + 1, second - first - 1))));
+        }
+        if (second != std::string::npos)
+        {
+          o.jitter = std::chrono::microseconds(long(1000 * std::stod(value.substr(second + 1))));
+        }
+      }
+      else if (name == "--engine" && (value == "coro" || value == "callback"))
+      {
+#ifndef CBP_COROUTINE_ENGINE
+        if (value == "coro")
+        {
+          throw std::invalid_argument("coroutine engine is not built, use 'make CORO=1'");
+        }
+#endif
+        o.coro_engine = (value == "coro");
+      }
+      else if (name == "--trace" && !value.empty())
+      {
+#ifndef CBP_TRACE
+        throw std::invalid_argument("tracing is not built, use 'make TRACE=1'");
+#endif
+        o.trace_path = value;
+      }
+      else
+      {
+        throw std::invalid_argument("unknown option " + arg);
+      }
+    }
+
+    if (o.shm_only && o.shm_name.empty())
+    {
+      throw std::invalid_argument("--shm-only requires --shm=<name>");
+    }
+
+    if (o.series_raw && o.series_dir.empty())
+    {
+      throw std::invalid_argument("--series-raw requires --series=<dir>");
+    }
+
+    if (o.early_cycle < 0 || o.early_cycle > 1)
+    {
+      throw std::invalid_argument("--early-cycle needs percent in 0..100");
+    }
+
+    if (o.push && (o.push_temperature < 0 || o.push_brightness < 0 ||
+                   o.push_min.count() < 0 || o.push_keepalive.count() <= 0))
+    {
+      throw std::invalid_argument("--push needs non-negative deltas and interval, positive keepalive");
+    }
+
+    if (o.shards < 1 || o.shards > max_shards)
+    {
+      throw std::invalid_argument("--shards needs 1..1024 shards");
+    }
+
+    if (o.discovery_rate <= 0 || o.discovery_burst < 1)
+    {
+      throw std::invalid_argument("--discovery needs positive rate and burst");
+    }
+
+    if (o.sample_rate > max_sample_rate)
+    {
+      throw std::invalid_argument("--sample rate is limited to 1000 Hz");
+    }
+
+    if (o.render_fps > max_render_fps)
+    {
+      throw std::invalid_argument("--render is limited to 1000 fps");
+    }
+
+    if (o.loss < 0 || o.loss > 1 || o.delay.count() < 0 || o.jitter.count() < 0)
+    {
+      throw std::invalid_argument("--loss needs percent in 0..100 and non-negative delays");
+    }
+
+    return o;
+  }
+
+  void
+  block_options::print_usage(std::ostream &os)
+  {
+    os << "  Options:\n";
+    os << "    --shm=<name>  exchange packets with co-located blocks through shared memory\n";
+    os << "    --shm-only    do not use UDP toward remote blocks (requires --shm)\n";
+    os << "    --state=<path>  keep id, master and slaves in file for warm restart\n";
+    os << "    --cycle=<min_ms>:<max_ms>  bounds of adaptive get_data cycle, default 1000:10000\n";
+    os << "    --early-cycle[=<percent>]  master: end get_data cycle once all (or percent of) expected slaves answered\n";
+    os << "    --push=<dT>:<dB>[:<min_ms>[:<keepalive_s>]]  master: set_data on average change, default 1000 ms, 60 s\n";
+    os << "    --per-slave   master: batched set_data with brightness of every slave by its own sensor\n";
+    os << "    --shards=<n>  master: poll one of n shards of slaves per get_data cycle, in turn\n";
+    os << "    --discovery=<per_s>[:<burst>]  limit of discovery multicasts, default 1:4\n";
+    os << "    --auth=<key_file>  sign packets with pre-shared key (32 hex digits), drop unsigned ones\n";
+    os << "    --sample=<hz>  slave: read sensors <hz> times a second, answer get_data with summary\n";
+    os << "    --render[=<fps>]  slave: draw display on own thread, newest data only, default 30 fps\n";
+    os << "    --busy-poll=<cpu>[:<spin_us>]  master: pin to cpu and busy poll, spin default 50us\n";
+    os << "    --latency     master: print wake-to-handle latency percentiles every cycle\n";
+    os << "    --series=<dir>  master: append cycle averages to ring file <dir>/average.ring\n";
+    os << "    --series-raw  master: also append every slave reading to <dir>/raw.ring\n";
+    os << "    --status=<path>  answer status queries (JSON) on Unix socket <path>\n";
+    os << "    --loss=<percent>[:<delay_ms>[:<jitter_ms>]]  drop and delay sent packets (testing)\n";
+    os << "    --engine=coro|callback  protocol engine, default callback\n";
+    os << "    --trace=<file>  write Chrome trace JSON of states, packets and timers on exit\n";
+  }
+} // namespace cbp
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace cbp
+{
+  // Optional block settings given on command line after positional arguments
+  // in the form --name or --name=value
+  struct block_options
+  {
+    // Shared memory segment name for co-located blocks, empty - UDP only
+    std::string shm_name;
+    // Exchange packets only through shared memory (no UDP toward remote blocks)
+    bool shm_only = {false};
+    // File keeping block id, last master and known slaves for warm restart,
+    // empty - always start with full discovery
+    std::string state_path;
+    // Bounds of adaptive get_data cycle of master
+    std::chrono::milliseconds cycle_min = {std::chrono::seconds(1)};
+    std::chrono::milliseconds cycle_max = {std::chrono::seconds(10)};
+    // Master: share of expected slaves whose responses close get_data cycle
+    // before its timer, 0 - always wait full cycle
+    double early_cycle = {0};
+    // Master: push set_data as soon as average temperature or brightness has
+    // moved by push delta since last sent (at most once per push_min), else
+    // resend every push_keepalive; off - set_data every N cycles
+    bool push = {false};
+    int push_temperature = {0};
+    int push_brightness = {0};
+    std::chrono::milliseconds push_min = {std::chrono::seconds(1)};
+    std::chrono::seconds push_keepalive = {std::chrono::seconds(60)};
+    // Master: set_data_batch frames give every slave brightness of its own
+    // sensor instead of one set_data with fleet average
+    bool per_slave = {false};
+    // Master: fleet is split into shards by slave id, every get_data_req
+    // polls one of them in turn; 1 - every slave answers every request
+    unsigned shards = {1};
+    // Discovery multicasts (slave_needed_req, master_needed_req) per second
+    // and burst above it; more of them are not sent
+    double discovery_rate = {1};
+    unsigned discovery_burst = {4};
+    // Packet authentication: 128-bit pre-shared key read from file, every
+    // packet is sent with its tag and dropped on receive without a valid one
+    bool auth = {false};
+    std::array<uint8_t, 16> auth_key = {};
+    // Slave: sensor readings per second between get_data requests, answered
+    // with their summary; 0 - sensors read once per get_data_req
+    unsigned sample_rate = {0};
+    // Slave: frames per second of display drawn on own thread, newest
+    // display_data only; 0 - drawn by protocol thread on arrival
+    unsigned render_fps = {0};
+    // Master: CPU to pin busy polling loop to (-1 - blocking io_context.run)
+    // and time to spin without events before backing off into poll()
+    int busy_poll_cpu = {-1};
+    std::chrono::microseconds busy_poll_spin = {std::chrono::microseconds(50)};
+    // Master: print wake-to-handle latency percentiles every cycle
+    bool latency = {false};
+    // Master: directory of time series ring files, empty - averages only printed
+    std::string series_dir;
+    // Master: also keep every slave reading, not only cycle averages
+    bool series_raw = {false};
+    // Unix socket answering status queries, empty - none
+    std::string status_path;
+    // Impaired network: probability to drop a sent packet, delay and
+    // uniform jitter added to the rest
+    double loss = {0};
+    std::chrono::microseconds delay = {std::chrono::microseconds::zero()};
+    std::chrono::microseconds jitter = {std::chrono::microseconds::zero()};
+    // Protocol engine: coroutines (coro_block) instead of callbacks
+    bool coro_engine = {false};
+    // Chrome trace JSON of protocol events written on exit, empty - none
+    std::string trace_path;
+    // Not on command line: block id drawn from this seed instead of random
+    // (fleet_sim, same election on every run), 0 - random
+    unsigned id_seed = {0};
+
+    // Constants
+    static constexpr unsigned max_sample_rate = 1000;
+    static constexpr unsigned max_shards = 1024;
+    static constexpr unsigned max_render_fps = 1000;
+
+    static block_options parse(int argc, char *argv[], int first);
+    static void print_usage(std::ostream &os);
+  };
+
+} // namespace cbp
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "packet_auth.hpp"
+
+namespace cbp
+{
+  static inline uint64_t
+  rotl(uint64_t x, int b)
+  {
+    return (x << b) | (x >> (64 - b));
+  }
+
+  static inline uint64_t
+  load_le64(const uint8_t *p)
+  {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+      v |= uint64_t(p[i]) << (8 * i);
+    }
+    return v;
+  }
+
+  // Last word: up to 7 trailing bytes and length in the top byte
+  static inline uint64_t
+  last_word(const uint8_t *data, size_t len)
+  {
+    uint64_t b = uint64_t(len) << 56;
+    for (size_t i = 0; i < len % 8; ++i)
+    {
+      b |= uint64_t(data[len - len % 8 + i]) << (8 * i);
+    }
+    return b;
+  }
+
+  static inline void
+  sip_round(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3)
+  {
+    v0 += v1;
+    v1 = rotl(v1, 13);
+    v1 ^= v0;
+    v0 = rotl(v0, 32);
+    v2 += v3;
+    v3 = rotl(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotl(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotl(v1, 17);
+    v1 ^= v2;
+    v2 = rotl(v2, 32);
+  }
+
+  packet_auth::packet_auth(const key_type &key)
+      : k0_(load_le64(key.data())),
+        k1_(load_le64(key.data() + 8))
+  {
+  }
+
+  uint64_t
+  packet_auth::siphash(const uint8_t *data, size_t len) const
+  {
+    uint64_t v0 = k0_ ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1_ ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0_ ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1_ ^ 0x7465646279746573ULL;
+
+    for (size_t i = 0; i + 8 <= len; i += 8)
+    {
+      const uint64_t m = load_le64(data + i);
+      v3 ^= m;
+      sip_round(v0, v1, v2, v3);
+      sip_round(v0, v1, v2, v3);
+      v0 ^= m;
+    }
+
+    const uint64_t b = last_word(data, len);
+    v3 ^= b;
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    for (int r = 0; r < 4; ++r)
+    {
+      sip_round(v0, v1, v2, v3);
+    }
+
+    return v0 ^ v1 ^ v2 ^ v3;
+  }
+
+  void
+  packet_auth::verify(const signed_packet *packets, size_t n, bool *ok) const
+  {
+    for (size_t i = 0; i < n; ++i)
+    {
+      ok[i] = verify(packets[i].data, packets[i].len, packets[i].tag);
+    }
+  }
+
+  void
+  auth_transport::async_send_to(asio::const_buffer buf, const endpoint &destination, handler h)
+  {
+    if (free_.empty())
+    {
+      free_.push_back(&slots_.emplace_back());
+    }
+
+    slot &s = *free_.back();
+    free_.pop_back();
+
+    const size_t len = std::min(buf.size(), max_packet_len);
+    std::memcpy(s.data, buf.data(), len);
+    const size_t signed_len = auth_.sign(s.data, len, ++counter_);
+    s.h = std::move(h);
+
+    inner_->async_send_to(asio::buffer(s.data, signed_len), destination,
+                          [this, &s](const asio::error_code &error, size_t n)
+                          {
+                            handler h = std::move(s.h);
+                            free_.push_back(&s);
+                            h(error, n > packet_auth::trailer_len ? n - packet_auth::trailer_len : n);
+                          });
+  }
+
+  uint64_t
+  auth_transport::first_counter()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  bool
+  replay_table::accept(const boost::uuids::uuid &id, uint64_t counter)
+  {
+    const size_t home = boost::uuids::hash_value(id) & (capacity - 1);
+
+    for (size_t n = 0, i = home; n < max_probe; ++n, i = (i + 1) & (capacity - 1))
+    {
+      entry &e = entries_[i];
+
+      if (!e.used)
+      {
+        e = {id, true, {}};
+        return e.window.accept(counter);
+      }
+
+      if (e.id == id)
+      {
+        return e.window.accept(counter);
+      }
+    }
+
+    entries_[home] = {id, true, {}};
+    return entries_[home].window.accept(counter);
+  }
+
+} // namespace cbp
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "boost/uuid/uuid.hpp"
+
+#include "cbp_base.hpp"
+#include "transport.hpp"
+
+namespace cbp
+{
+  // Packet authentication (--auth): SipHash-2-4 of every packet under a
+  // pre-shared 128-bit key. The packet is followed by an 8 byte counter of
+  // its sender and the 8 byte tag of both. Packet is signed as sent, with
+  // session_header too: the session stands for the block id the master gave
+  // it to. Counter grows with every packet sent by a block and starts from
+  // wall clock microseconds, so it keeps growing over restarts; receiver
+  // takes every counter of a sender once (replay_window).
+  class packet_auth
+  {
+  public:
+    using key_type = std::array<uint8_t, 16>;
+
+    // Packet of len bytes (without trailer), its counter follows it in data
+    struct signed_packet
+    {
+      const uint8_t *data;
+      size_t len;
+      uint64_t tag;
+    };
+
+    explicit packet_auth(const key_type &key);
+
+    uint64_t siphash(const uint8_t *data, size_t len) const;
+
+    // Counter and tag after packet of len bytes in net_buf, returns length
+    // with them
+    size_t
+    sign(uint8_t *net_buf, size_t len, uint64_t counter) const
+    {
+      tag_to_netbuf(net_buf + len, counter);
+      tag_to_netbuf(net_buf + len + counter_len, siphash(net_buf, len + counter_len));
+      return len + trailer_len;
+    }
+
+    // Packet of len bytes followed by its counter
+    bool verify(const uint8_t *net_buf, size_t len, uint64_t tag) const { return siphash(net_buf, len + counter_len) == tag; }
+
+    // Batch of n packets, ok[i] is the result of packets[i]
+    void verify(const signed_packet *packets, size_t n, bool *ok) const;
+
+    static uint64_t
+    tag_from_netbuf(const uint8_t *net_buf)
+    {
+      uint64_t tag = 0;
+      for (size_t i = 0; i < tag_len; ++i)
+      {
+        tag |= uint64_t(net_buf[i]) << (8 * i);
+      }
+      return tag;
+    }
+
+    static void
+    tag_to_netbuf(uint8_t *net_buf, uint64_t tag)
+    {
+      for (size_t i = 0; i < tag_len; ++i)
+      {
+        net_buf[i] = uint8_t(tag >> (8 * i));
+      }
+    }
+
+    // Counter is stored as the tag is
+    static uint64_t counter_from_netbuf(const uint8_t *net_buf) { return tag_from_netbuf(net_buf); }
+
+    // Constants
+    static constexpr size_t tag_len = 8;
+    static constexpr size_t counter_len = 8;
+    static constexpr size_t trailer_len = auth_trailer_len;
+
+    static_assert(trailer_len == counter_len + tag_len);
+
+  private:
+    uint64_t k0_;
+    uint64_t k1_;
+  };
+
+  // Anti-replay state of one sender: highest counter taken and which of the
+  // window below it were taken too, so packets reordered on the way (or put
+  // aside by overload protection) still pass, each of them once
+  struct replay_window
+  {
+    uint64_t last = {0};
+    uint64_t seen = {0}; // bit i - counter last - i
+
+    bool
+    accept(uint64_t counter)
+    {
+      if (counter > last)
+      {
+        const uint64_t shift = counter - last;
+        seen = (shift < window) ? (seen << shift) | 1 : 1;
+        last = counter;
+        return true;
+      }
+
+      const uint64_t age = last - counter;
+      if (age >= window || (seen >> age) & 1)
+      {
+        return false;
+      }
+
+      seen |= uint64_t(1) << age;
+      return true;
+    }
+
+    // Constants
+    static constexpr uint64_t window = 64;
+  };
+
+  // Replay windows of senders by block id, for packets with packet_header
+  // (master keeps ones of session_header by session). Fixed table, filled
+  // only by packets with a valid tag; a sender not found within max_probe
+  // entries takes over its home entry, its old window is lost
+  class replay_table
+  {
+  public:
+    replay_table() : entries_(capacity) {}
+
+    bool accept(const boost::uuids::uuid &id, uint64_t counter);
+
+    // Constants
+    static constexpr size_t capacity = 4096; // power of 2
+    static constexpr size_t max_probe = 16;
+
+  private:
+    struct entry
+    {
+      boost::uuids::uuid id;
+      bool used;
+      replay_window window;
+    };
+
+    std::vector<entry> entries_;
+  };
+
+  // Signs every sent packet: it is copied with its counter and tag into a
+  // send slot, free again on completion. Slots are only added (up to the
+  // number of sends in flight), so steady sending does not allocate.
+  // Receiving is passed through, tags and counters are checked by
+  // control_block::is_packet_valid.
+  class auth_transport : public transport
+  {
+  public:
+    auth_transport(std::unique_ptr<transport> inner, const packet_auth::key_type &key)
+        : inner_(std::move(inner)), auth_(key), counter_(first_counter())
+    {
+    }
+
+    // Wall clock microseconds: above every counter sent before a restart
+    static uint64_t first_counter();
+
+    void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override
+    {
+      inner_->async_receive_from(buf, sender, std::move(h));
+    }
+
+    void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override;
+
+    void cancel_receive() override { inner_->cancel_receive(); }
+    void set_busy_poll(std::chrono::microseconds spin) override { inner_->set_busy_poll(spin); }
+    void poll_fds(std::vector<int> &fds) override { inner_->poll_fds(fds); }
+    bool receive_time(std::chrono::system_clock::time_point &tp) override { return inner_->receive_time(tp); }
+    bool backlog() override { return inner_->backlog(); }
+
+  private:
+    struct slot
+    {
+      handler h;
+      uint8_t data[max_datagram_len];
+    };
+
+    std::unique_ptr<transport> inner_;
+    packet_auth auth_;
+    uint64_t counter_;
+
+    std::deque<slot> slots_; // stable addresses, in flight or free
+    std::vector<slot *> free_;
+  };
+
+} // namespace cbp
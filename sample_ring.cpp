@@ -0,0 +1,20 @@
+#include "sample_ring.hpp"
+
+namespace cbp
+{
+  sensor_summary
+  sample_ring::take_summary()
+  {
+    sensor_summary s;
+    for (size_t i = 0; i < count_; ++i)
+    {
+      s.add(ring_[(head_ + i) % capacity]);
+    }
+
+    head_ = (head_ + count_) % capacity;
+    count_ = 0;
+
+    return s;
+  }
+
+} // namespace cbp
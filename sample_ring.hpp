@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "cbp_base.hpp"
+
+namespace cbp
+{
+  // Sensor readings of a slave between get_data requests (--sample).
+  // Fixed ring: when full the oldest readings are overwritten, so a summary
+  // covers at most the last capacity of them.
+  class sample_ring
+  {
+  public:
+    // Constants
+    // 15s cycle at 100 Hz fits
+    static constexpr size_t capacity = 2048;
+
+    sample_ring() : ring_(capacity) {}
+
+    void push(const sensor_data &s)
+    {
+      ring_[(head_ + count_) % capacity] = s;
+      if (count_ < capacity)
+      {
+        ++count_;
+      }
+      else
+      {
+        head_ = (head_ + 1) % capacity;
+      }
+    }
+
+    bool empty() const { return count_ == 0; }
+    const sensor_data &last() const { return ring_[(head_ + count_ - 1) % capacity]; }
+
+    // Summary of readings since previous call, ring is emptied. Ring must
+    // not be empty
+    sensor_summary take_summary();
+
+  private:
+    std::vector<sensor_data> ring_;
+    size_t head_ = {0};
+    size_t count_ = {0};
+  };
+
+} // namespace cbp
@@ -0,0 +1,109 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "asio.hpp"
+#include "boost/uuid/uuid_generators.hpp"
+
+#include "cbp_base.hpp"
+
+// Send path of a control packet: header encoded into send_buf_ on every send
+// (packet_header::to_netbuf) versus packet_templates, alone and followed by a
+// real UDP send to a local socket.
+
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+  volatile uint8_t sink;
+
+  template <typename F>
+  void
+  measure(const char *name, size_t n, F f)
+  {
+    const auto start = clock_type::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+      f(i);
+    }
+    const double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+
+    std::cout << name << ": " << ns / double(n) << " ns/packet" << std::endl;
+  }
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 2)
+  {
+    std::cerr << "Usage: send_bench [packets]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    send_bench 1000000\n";
+    return 1;
+  }
+
+  const size_t n = (argc == 2) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const boost::uuids::uuid id = boost::uuids::random_generator()();
+  const auto pt = cbp::packet_header::packet_type::get_data_req;
+  const auto mode = cbp::packet_header::block_mode::master;
+
+  uint8_t send_buf[cbp::max_packet_len] = {0};
+  cbp::packet_templates templates;
+  templates.build(id);
+
+  cbp::sensor_data sensors;
+  sensors.temperature = 21;
+  sensors.brightness = 450;
+
+  std::cout << "packets=" << n << std::endl;
+
+  measure("encode header      ", n * 10, [&](size_t i)
+          {
+            cbp::packet_header::to_netbuf(send_buf, pt, mode, id);
+            sink = send_buf[i % sizeof(cbp::packet_header)];
+          });
+
+  measure("template header    ", n * 10, [&](size_t i)
+          {
+            const uint8_t *p = templates.get(pt, mode);
+            sink = p[i % sizeof(cbp::packet_header)];
+          });
+
+  measure("encode get_data_rsp", n * 10, [&](size_t i)
+          {
+            cbp::packet_header::to_netbuf(send_buf, cbp::packet_header::packet_type::get_data_rsp,
+                                          cbp::packet_header::block_mode::slave, id);
+            sensors.to_netbuf(send_buf);
+            sink = send_buf[i % sizeof(send_buf)];
+          });
+
+  measure("copy get_data_rsp  ", n * 10, [&](size_t i)
+          {
+            templates.to_netbuf(send_buf, cbp::packet_header::packet_type::get_data_rsp,
+                                cbp::packet_header::block_mode::slave);
+            sensors.to_netbuf(send_buf);
+            sink = send_buf[i % sizeof(send_buf)];
+          });
+
+  // Same with a datagram really sent, receiver never reads (kernel drops)
+  asio::io_context io_context;
+  asio::ip::udp::socket receiver(io_context, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  asio::ip::udp::socket sender(io_context, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  const auto destination = receiver.local_endpoint();
+  asio::error_code error;
+
+  measure("encode + send_to   ", n, [&](size_t)
+          {
+            cbp::packet_header::to_netbuf(send_buf, pt, mode, id);
+            sender.send_to(asio::buffer(send_buf, sizeof(cbp::packet_header)), destination, 0, error);
+          });
+
+  measure("template + send_to ", n, [&](size_t)
+          {
+            sender.send_to(asio::buffer(templates.get(pt, mode), sizeof(cbp::packet_header)),
+                           destination, 0, error);
+          });
+
+  return 0;
+}
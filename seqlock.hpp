@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace cbp
+{
+  // Single writer, many readers value of trivially copyable T.
+  // Writer never waits: sequence is odd while value is copied in. Reader
+  // copies value out and retries if sequence was odd or has changed, so
+  // readers cost the writer nothing but a cache line.
+  template <typename T>
+  class seqlock
+  {
+    static_assert(std::is_trivially_copyable_v<T>, "seqlock value must be trivially copyable");
+
+  public:
+    void store(const T &v)
+    {
+      const uint64_t s = seq_.load(std::memory_order_relaxed);
+      seq_.store(s + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      std::memcpy(static_cast<void *>(&value_), &v, sizeof(T));
+
+      seq_.store(s + 2, std::memory_order_release);
+    }
+
+    T load() const
+    {
+      T v;
+      for (;;)
+      {
+        const uint64_t s = seq_.load(std::memory_order_acquire);
+        if (!(s & 1))
+        {
+          std::memcpy(static_cast<void *>(&v), &value_, sizeof(T));
+          std::atomic_thread_fence(std::memory_order_acquire);
+
+          if (seq_.load(std::memory_order_relaxed) == s)
+          {
+            return v;
+          }
+        }
+        std::this_thread::yield();
+      }
+    }
+
+    // Number of stores so far
+    uint64_t version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+  private:
+    std::atomic<uint64_t> seq_ = {0};
+    T value_ = {};
+  };
+
+} // namespace cbp
@@ -0,0 +1,84 @@
+#include <cstdlib>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include "series_ring.hpp"
+
+// Reads a series ring written by master (--series=<dir>) while it keeps
+// running: last rows as is, or downsampled into buckets of one column.
+
+namespace
+{
+  void
+  print_time(int64_t ms)
+  {
+    char buf[32];
+    std::time_t t = ms / 1000;
+    std::strftime(buf, sizeof(buf), "%F %T", std::localtime(&t));
+    std::cout << buf;
+  }
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  if (argc < 2 || argc > 5)
+  {
+    std::cerr << "Usage: series_query <file> [last_seconds] [step_seconds] [column]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    series_query series/average.ring 3600 60 1\n";
+    std::cerr << "  average.ring columns: temperature brightness responses\n";
+    std::cerr << "  raw.ring columns:     slave temperature brightness\n";
+    return 1;
+  }
+
+  try
+  {
+    cbp::series_ring ring(argv[1]);
+
+    const int64_t to = cbp::series_ring::now_ms() + 1;
+    const int64_t from = (argc > 2) ? to - 1000 * std::strtoll(argv[2], nullptr, 10) : 0;
+
+    if (argc > 3)
+    {
+      const int64_t step = 1000 * std::strtoll(argv[3], nullptr, 10);
+      const unsigned column = (argc > 4) ? std::strtoul(argv[4], nullptr, 10) : 0;
+
+      std::vector<cbp::series_ring::bucket> buckets;
+      ring.downsample(from, to, step, column, buckets);
+
+      for (const auto &b : buckets)
+      {
+        print_time(b.time_ms);
+        std::cout << " n=" << b.rows
+                  << " mean=" << double(b.sum) / double(b.rows)
+                  << " min=" << b.min
+                  << " max=" << b.max
+                  << std::endl;
+      }
+      return 0;
+    }
+
+    std::vector<cbp::series_ring::row> rows;
+    ring.scan(from, to, rows);
+
+    for (const auto &r : rows)
+    {
+      print_time(r.time_ms);
+      for (unsigned c = 0; c < ring.columns(); ++c)
+      {
+        std::cout << " " << r.values[c];
+      }
+      std::cout << std::endl;
+    }
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "asio.hpp"
+
+#include "series_ring.hpp"
+
+namespace cbp
+{
+  static void
+  throw_errno(const char *what)
+  {
+    throw asio::system_error(asio::error_code(errno, asio::error::get_system_category()), what);
+  }
+
+  series_ring::series_ring(const std::string &path, unsigned columns, uint64_t capacity)
+  {
+    if (!columns || columns > max_columns || !capacity)
+    {
+      throw std::invalid_argument("series ring needs 1..4 columns and non-zero capacity");
+    }
+
+    fd_ = ::open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+      throw_errno("open series file");
+    }
+
+    size_ = file_size(columns, capacity);
+    if (::ftruncate(fd_, size_) < 0)
+    {
+      ::close(fd_);
+      throw_errno("ftruncate series file");
+    }
+
+    map(PROT_READ | PROT_WRITE);
+
+    if (header_->magic != magic || header_->version != version ||
+        header_->columns != columns || header_->capacity != capacity)
+    {
+      std::memset(static_cast<void *>(header_), 0, sizeof(header));
+      header_->magic = magic;
+      header_->version = version;
+      header_->columns = columns;
+      header_->capacity = capacity;
+    }
+
+    // Row being written when previous writer died is simply rewritten
+    header_->writing.store(header_->head.load());
+    locate_columns();
+  }
+
+  series_ring::series_ring(const std::string &path)
+  {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+    {
+      throw_errno("open series file");
+    }
+
+    struct stat st;
+    if (::fstat(fd_, &st) < 0)
+    {
+      ::close(fd_);
+      throw_errno("stat series file");
+    }
+
+    size_ = st.st_size;
+    if (size_ < sizeof(header))
+    {
+      ::close(fd_);
+      throw std::runtime_error("not a series file: " + path);
+    }
+
+    map(PROT_READ);
+
+    if (header_->magic != magic || header_->version != version ||
+        header_->columns > max_columns || size_ != file_size(header_->columns, header_->capacity))
+    {
+      ::munmap(header_, size_);
+      ::close(fd_);
+      throw std::runtime_error("not a series file: " + path);
+    }
+
+    locate_columns();
+  }
+
+  series_ring::~series_ring()
+  {
+    ::munmap(header_, size_);
+    ::close(fd_);
+  }
+
+  void
+  series_ring::map(int prot)
+  {
+    void *p = ::mmap(nullptr, size_, prot, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+    {
+      ::close(fd_);
+      throw_errno("mmap series file");
+    }
+
+    header_ = static_cast<header *>(p);
+  }
+
+  void
+  series_ring::locate_columns()
+  {
+    time_ = reinterpret_cast<int64_t *>(header_ + 1);
+    values_ = reinterpret_cast<int32_t *>(time_ + header_->capacity);
+  }
+
+  int64_t
+  series_ring::now_ms()
+  {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  uint64_t
+  series_ring::size() const
+  {
+    return std::min(header_->head.load(std::memory_order_acquire), header_->capacity);
+  }
+
+  void
+  series_ring::append(int64_t time_ms, const int32_t *values)
+  {
+    const uint64_t cap = header_->capacity;
+    const uint64_t h = header_->head.load(std::memory_order_relaxed);
+    const uint64_t slot = h % cap;
+
+    // Readers seeing any store below know row h - capacity is gone
+    header_->writing.store(h + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Time column stays sorted for range lookups even if clock steps back
+    header_->last_time_ms = std::max(header_->last_time_ms, time_ms);
+    time_[slot] = header_->last_time_ms;
+
+    for (unsigned c = 0; c < header_->columns; ++c)
+    {
+      values_[c * cap + slot] = values[c];
+    }
+
+    header_->head.store(h + 1, std::memory_order_release);
+  }
+
+  uint64_t
+  series_ring::lower_bound(uint64_t first, uint64_t last, int64_t t) const
+  {
+    const uint64_t cap = header_->capacity;
+
+    while (first < last)
+    {
+      const uint64_t mid = first + (last - first) / 2;
+      if (time_[mid % cap] < t)
+      {
+        first = mid + 1;
+      }
+      else
+      {
+        last = mid;
+      }
+    }
+
+    return first;
+  }
+
+  void
+  series_ring::window(int64_t from_ms, int64_t to_ms, uint64_t &first, uint64_t &last) const
+  {
+    const uint64_t h = header_->head.load(std::memory_order_acquire);
+    const uint64_t oldest = (h > header_->capacity) ? h - header_->capacity : 0;
+
+    // Slots overwritten during the search only make the range wider,
+    // rows are filtered by time again after copy
+    first = lower_bound(oldest, h, from_ms);
+    last = lower_bound(first, h, to_ms);
+  }
+
+  uint64_t
+  series_ring::oldest_intact() const
+  {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t w = header_->writing.load(std::memory_order_relaxed);
+    return (w > header_->capacity) ? w - header_->capacity : 0;
+  }
+
+  void
+  series_ring::scan(int64_t from_ms, int64_t to_ms, std::vector<row> &out) const
+  {
+    const uint64_t cap = header_->capacity;
+    const unsigned columns = header_->columns;
+    uint64_t first, last;
+
+    window(from_ms, to_ms, first, last);
+
+    const size_t start = out.size();
+    out.resize(start + (last - first));
+
+    for (uint64_t i = first; i < last; ++i)
+    {
+      row &r = out[start + (i - first)];
+      const uint64_t slot = i % cap;
+
+      r.time_ms = time_[slot];
+      for (unsigned c = 0; c < max_columns; ++c)
+      {
+        r.values[c] = (c < columns) ? values_[c * cap + slot] : 0;
+      }
+    }
+
+    // Drop rows overwritten while copying and rows outside range
+    const uint64_t intact = oldest_intact();
+    auto begin = out.begin() + start;
+    auto end = begin + (first < intact ? std::min(intact, last) - first : 0);
+
+    out.erase(std::remove_if(end, out.end(), [from_ms, to_ms](const row &r)
+                             { return r.time_ms < from_ms || r.time_ms >= to_ms; }),
+              out.end());
+    out.erase(begin, end);
+  }
+
+  void
+  series_ring::downsample(int64_t from_ms, int64_t to_ms, int64_t step_ms, unsigned column,
+                          std::vector<bucket> &out) const
+  {
+    if (step_ms <= 0 || column >= header_->columns)
+    {
+      throw std::invalid_argument("downsample needs positive step and existing column");
+    }
+
+    // Only time and one value column are touched
+    const uint64_t cap = header_->capacity;
+    const int32_t *values = values_ + column * cap;
+    uint64_t first, last;
+
+    window(from_ms, to_ms, first, last);
+
+    std::vector<std::pair<int64_t, int32_t>> points(last - first);
+    for (uint64_t i = first; i < last; ++i)
+    {
+      points[i - first] = {time_[i % cap], values[i % cap]};
+    }
+
+    const uint64_t intact = oldest_intact();
+    const size_t skip = (first < intact) ? std::min(intact, last) - first : 0;
+
+    for (size_t i = skip; i < points.size(); ++i)
+    {
+      const auto [t, v] = points[i];
+      if (t < from_ms || t >= to_ms)
+      {
+        continue;
+      }
+
+      const int64_t start = from_ms + (t - from_ms) / step_ms * step_ms;
+      if (out.empty() || out.back().time_ms != start)
+      {
+        out.push_back(bucket{start, 0, 0, v, v});
+      }
+
+      bucket &b = out.back();
+      ++b.rows;
+      b.sum += v;
+      b.min = std::min(b.min, v);
+      b.max = std::max(b.max, v);
+    }
+  }
+
+} // namespace cbp
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cbp
+{
+  // Time series of master readings kept in a ring file (--series=<dir>).
+  // Fixed capacity file mapped with MAP_SHARED, columnar layout: time column
+  // (ms since epoch, never decreasing) followed by up to max_columns int32
+  // value columns. Append is a few stores into the page cache and a release
+  // store of head_, no locks or write calls on the packet path.
+  //
+  // Readers (another thread or process mapping the same file read-only) are
+  // lock-free: rows are copied out of the window [head - capacity, head) and
+  // those the writer could have overwritten meanwhile are dropped afterwards,
+  // so a query never blocks the protocol loop and vice versa.
+  class series_ring
+  {
+  public:
+    // Constants
+    static constexpr uint32_t magic = 0x43425354; // "CBST"
+    static constexpr uint32_t version = 1;
+    static constexpr unsigned max_columns = 4;
+
+    struct row
+    {
+      int64_t time_ms;
+      int32_t values[max_columns];
+    };
+
+    struct bucket
+    {
+      int64_t time_ms; // bucket start
+      uint64_t rows;
+      int64_t sum;
+      int32_t min;
+      int32_t max;
+    };
+
+    // Writer: create file or reopen existing one of same layout (rows kept)
+    series_ring(const std::string &path, unsigned columns, uint64_t capacity);
+    // Reader: map existing file read-only
+    explicit series_ring(const std::string &path);
+    ~series_ring();
+
+    series_ring(const series_ring &) = delete;
+    series_ring &operator=(const series_ring &) = delete;
+
+    // values must hold columns() items
+    void append(int64_t time_ms, const int32_t *values);
+
+    // Rows with from_ms <= time < to_ms, oldest first
+    void scan(int64_t from_ms, int64_t to_ms, std::vector<row> &out) const;
+
+    // Rows of [from_ms, to_ms) folded into step_ms buckets of one column,
+    // empty buckets are skipped
+    void downsample(int64_t from_ms, int64_t to_ms, int64_t step_ms, unsigned column,
+                    std::vector<bucket> &out) const;
+
+    unsigned columns() const { return header_->columns; }
+    uint64_t capacity() const { return header_->capacity; }
+    uint64_t size() const;
+
+    static int64_t now_ms();
+
+  private:
+    struct alignas(64) header
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t columns;
+      uint32_t pad;
+      uint64_t capacity;
+      std::atomic<uint64_t> head;    // rows ever appended
+      std::atomic<uint64_t> writing; // head + 1 while a row is written
+      int64_t last_time_ms;
+    };
+
+    static size_t file_size(unsigned columns, uint64_t capacity)
+    {
+      return sizeof(header) + capacity * (sizeof(int64_t) + columns * sizeof(int32_t));
+    }
+
+    void map(int prot);
+    // Column pointers, once header is valid
+    void locate_columns();
+
+    // First absolute row index in [first, last) with time >= t
+    uint64_t lower_bound(uint64_t first, uint64_t last, int64_t t) const;
+    // Absolute row range for [from_ms, to_ms) at the moment of call
+    void window(int64_t from_ms, int64_t to_ms, uint64_t &first, uint64_t &last) const;
+    // Rows before returned index could be overwritten since window()
+    uint64_t oldest_intact() const;
+
+    int fd_ = {-1};
+    size_t size_ = {0};
+    header *header_ = {nullptr};
+    int64_t *time_ = {nullptr};
+    int32_t *values_ = {nullptr}; // columns * capacity, column after column
+  };
+
+} // namespace cbp
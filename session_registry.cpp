@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <random>
+
+#include "session_registry.hpp"
+
+namespace cbp
+{
+  session_registry::session_registry()
+      : epoch_(std::random_device()()),
+        ids_(1),
+        notified_(1),
+        revoked_(max_sessions + 1)
+  {
+  }
+
+  uint16_t
+  session_registry::assign(const boost::uuids::uuid &id)
+  {
+    auto it = sessions_.find(id);
+    if (it != sessions_.end())
+    {
+      return it->second;
+    }
+
+    // Ids ran out, start new epoch, slaves are given new ids as they answer
+    if (ids_.size() > max_sessions)
+    {
+      ++epoch_;
+      ids_.resize(1);
+      notified_.resize(1);
+      std::fill(revoked_.begin(), revoked_.end(), 0);
+      sessions_.clear();
+    }
+
+    const uint16_t session = ids_.size();
+    ids_.push_back(id);
+    notified_.push_back(0);
+    sessions_.emplace(id, session);
+
+    return session;
+  }
+
+} // namespace cbp
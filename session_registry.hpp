@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "boost/uuid/uuid.hpp"
+
+namespace cbp
+{
+  // Session ids of slaves of a master. A slave gets a dense id when it
+  // registers or first answers get_data, is told the id by session_assign
+  // and then sends get_data_rsp with session_header; master gets its block
+  // id back by index. Ids are not reused within an epoch. Epoch is random
+  // per master run and changes when ids run out, so ids given by a previous
+  // run or epoch are recognized as unknown.
+  class session_registry
+  {
+  public:
+    session_registry();
+
+    // Session of block id, new one if not known yet
+    uint16_t assign(const boost::uuids::uuid &id);
+
+    // Block id of session of current epoch, nullptr if unknown
+    const boost::uuids::uuid *find(uint16_t session, uint16_t epoch) const
+    {
+      return (epoch == epoch_ && session && session < ids_.size()) ? &ids_[session] : nullptr;
+    }
+
+    // Slave keeps sending packet_header: session_assign may be lost (or
+    // slave does not know sessions), so it is told again a few times
+    bool notify(uint16_t session)
+    {
+      return notified_[session] < max_notify && ++notified_[session];
+    }
+
+    // Unknown session (find() is nullptr) is revoked by session_assign with
+    // session 0, as many times per session number and epoch
+    bool revoke(uint16_t session)
+    {
+      return revoked_[session] < max_notify && ++revoked_[session];
+    }
+
+    uint16_t epoch() const { return epoch_; }
+    size_t size() const { return ids_.size() - 1; }
+
+    // Constants
+    static constexpr uint8_t max_notify = 3;
+    static constexpr size_t max_sessions = 0xffff;
+
+  private:
+    uint16_t epoch_;
+    std::vector<boost::uuids::uuid> ids_; // by session, 0 is none
+    std::vector<uint8_t> notified_;       // by session
+    std::vector<uint8_t> revoked_;        // by any session number
+    std::map<boost::uuids::uuid, uint16_t> sessions_;
+  };
+
+} // namespace cbp
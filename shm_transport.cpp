@@ -0,0 +1,494 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "shm_transport.hpp"
+
+namespace cbp
+{
+  static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                    std::atomic<uint32_t>::is_always_lock_free,
+                "shared memory ring requires address-free atomics");
+
+  static void
+  throw_errno(const char *what)
+  {
+    throw asio::system_error(asio::error_code(errno, asio::error::get_system_category()), what);
+  }
+
+  // Shared (not private) futex - waiter and waker are different processes
+  static void
+  futex_wait(std::atomic<uint32_t> &word, uint32_t val)
+  {
+    timespec ts = {0, 100 * 1000 * 1000};
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, val, &ts, nullptr, 0);
+  }
+
+  static void
+  futex_wake(std::atomic<uint32_t> &word)
+  {
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+  }
+
+  // OFD lock of one byte of the segment, released by the kernel with the
+  // descriptor, also when the process dies
+  static bool
+  lock_byte(int fd, off_t byte, short type, bool wait)
+  {
+    struct flock l = {};
+    l.l_type = type;
+    l.l_whence = SEEK_SET;
+    l.l_start = byte;
+    l.l_len = 1;
+    return ::fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &l) == 0;
+  }
+
+  shm_transport::shm_transport(asio::io_context &io_context,
+                               const asio::ip::address &listen_address,
+                               const asio::ip::address &multicast_address,
+                               const block_options &options)
+      : io_context_(io_context),
+        shm_name_("/cbp-" + options.shm_name),
+        event_fd_(io_context),
+        multicast_endpoint_(multicast_address, multicast_port)
+  {
+    for (;;)
+    {
+      shm_fd_ = ::shm_open(shm_name_.c_str(), O_CREAT | O_RDWR, 0600);
+      if (shm_fd_ < 0)
+      {
+        throw_errno("shm_open");
+      }
+
+      // Waits while the last peer leaving unlinks the segment
+      struct stat st;
+      if (!lock_byte(shm_fd_, attach_lock, F_RDLCK, true) || ::fstat(shm_fd_, &st) < 0)
+      {
+        ::close(shm_fd_);
+        throw_errno("shm lock");
+      }
+
+      if (st.st_nlink > 0)
+      {
+        break;
+      }
+
+      // Got the unlinked one, open again
+      ::close(shm_fd_);
+    }
+
+    // New segment is zero-filled, which is a valid state of all slots
+    void *p = MAP_FAILED;
+    if (::ftruncate(shm_fd_, sizeof(segment)) == 0)
+    {
+      p = ::mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd_, 0);
+    }
+    if (p == MAP_FAILED)
+    {
+      ::close(shm_fd_);
+      throw_errno("mmap");
+    }
+    segment_ = static_cast<segment *>(p);
+
+    claim_slot();
+
+    int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0)
+    {
+      throw_errno("eventfd");
+    }
+    event_fd_.assign(efd);
+
+    if (!options.shm_only)
+    {
+      // Shared multicast port, so several local blocks may bind it
+      asio::ip::udp::endpoint listen_endpoint(listen_address, multicast_port);
+      listen_leg_ = std::make_unique<udp_leg>(io_context);
+      listen_leg_->socket.open(listen_endpoint.protocol());
+      listen_leg_->socket.set_option(asio::ip::udp::socket::reuse_address(true));
+      listen_leg_->socket.bind(listen_endpoint);
+      listen_leg_->socket.set_option(asio::ip::multicast::join_group(multicast_address));
+
+      // Own port for sending, so unicast replies come back to this block only
+      send_leg_ = std::make_unique<udp_leg>(io_context);
+      send_leg_->socket.open(listen_endpoint.protocol());
+      send_leg_->socket.bind(asio::ip::udp::endpoint(listen_endpoint.protocol(), 0));
+      send_leg_->socket.set_option(asio::ip::multicast::enable_loopback(false));
+
+      receive_udp(*listen_leg_);
+      receive_udp(*send_leg_);
+    }
+
+    wait_inbox();
+    bridge_thread_ = std::thread(&shm_transport::bridge, this);
+
+    std::cout << "Shared memory transport " << shm_name_
+              << ", slot=" << self_
+              << (options.shm_only ? ", local only" : ", with UDP")
+              << std::endl;
+  }
+
+  shm_transport::~shm_transport()
+  {
+    peer &p = segment_->peers[self_];
+
+    stop_ = true;
+    futex_wake(p.wake);
+    bridge_thread_.join();
+
+    p.pid = 0;
+    p.used = 0;
+
+    ::munmap(segment_, sizeof(segment));
+
+    // Last one out: no other process has the attach byte read-locked
+    if (lock_byte(shm_fd_, attach_lock, F_WRLCK, false))
+    {
+      ::shm_unlink(shm_name_.c_str());
+    }
+    ::close(shm_fd_);
+  }
+
+  // Slot whose byte nobody holds: never used, left, or its owner is dead
+  void
+  shm_transport::claim_slot()
+  {
+    for (unsigned i = 0; i < max_peers; ++i)
+    {
+      if (lock_byte(shm_fd_, i, F_WRLCK, false))
+      {
+        self_ = i;
+        drain_inbox();
+
+        peer &p = segment_->peers[i];
+        p.pid = ::getpid();
+        p.used.store(1, std::memory_order_release);
+        return;
+      }
+    }
+
+    ::munmap(segment_, sizeof(segment));
+    ::close(shm_fd_);
+    throw std::runtime_error("no free peer slot in " + shm_name_);
+  }
+
+  // Packets sent to the previous owner. Consumer side only, producers
+  // in the middle of an enqueue are not disturbed (their packet arrives later)
+  void
+  shm_transport::drain_inbox()
+  {
+    uint8_t data[max_datagram_len];
+    size_t len = sizeof(data);
+    unsigned from = 0;
+
+    while (dequeue(data, len, from))
+    {
+      len = sizeof(data);
+    }
+  }
+
+  // Multi-producer enqueue into inbox of slot. False if peer is absent or inbox is full.
+  bool
+  shm_transport::enqueue(unsigned slot, const void *data, size_t len)
+  {
+    peer &p = segment_->peers[slot];
+    if (!p.used.load(std::memory_order_acquire) || len > max_datagram_len)
+    {
+      return false;
+    }
+
+    uint64_t pos = p.enqueue_pos.load(std::memory_order_relaxed);
+    cell *c = nullptr;
+
+    for (;;)
+    {
+      uint64_t idx = pos & (ring_size - 1);
+      c = &p.cells[idx];
+      int64_t dif = int64_t(c->seq.load(std::memory_order_acquire) + idx - pos);
+
+      if (dif == 0)
+      {
+        if (p.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (dif < 0)
+      {
+        // full
+        return false;
+      }
+      else
+      {
+        pos = p.enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    c->from = self_;
+    c->len = len;
+    std::memcpy(c->data, data, len);
+    c->seq.store(pos + 1 - (pos & (ring_size - 1)), std::memory_order_release);
+
+    p.wake.fetch_add(1);
+    if (p.sleeping.load())
+    {
+      futex_wake(p.wake);
+    }
+
+    return true;
+  }
+
+  // Single-consumer dequeue from own inbox
+  bool
+  shm_transport::dequeue(void *data, size_t &len, unsigned &from)
+  {
+    peer &p = segment_->peers[self_];
+
+    uint64_t pos = p.dequeue_pos.load(std::memory_order_relaxed);
+    uint64_t idx = pos & (ring_size - 1);
+    cell &c = p.cells[idx];
+
+    if (int64_t(c.seq.load(std::memory_order_acquire) + idx - (pos + 1)) < 0)
+    {
+      // empty
+      return false;
+    }
+
+    size_t n = std::min<size_t>(c.len, len);
+    std::memcpy(data, c.data, n);
+    len = c.len;
+    from = c.from;
+
+    c.seq.store(pos + ring_size - idx, std::memory_order_release);
+    p.dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  // Bridge thread: futex word of own slot -> eventfd watched by asio
+  void
+  shm_transport::bridge()
+  {
+    peer &p = segment_->peers[self_];
+    const uint64_t one = 1;
+
+    uint32_t seen = p.wake.load();
+    [[maybe_unused]] auto r = ::write(event_fd_.native_handle(), &one, sizeof(one));
+
+    while (!stop_)
+    {
+      uint32_t w = p.wake.load();
+      if (w != seen)
+      {
+        seen = w;
+        r = ::write(event_fd_.native_handle(), &one, sizeof(one));
+        continue;
+      }
+
+      p.sleeping.store(1);
+      if (p.wake.load() == seen)
+      {
+        futex_wait(p.wake, seen);
+      }
+      p.sleeping.store(0);
+    }
+  }
+
+  void
+  shm_transport::wait_inbox()
+  {
+    event_fd_.async_read_some(asio::buffer(&event_count_, sizeof(event_count_)),
+                              make_custom_alloc_handler(memory_, [this](const asio::error_code &error, size_t)
+                              {
+                                if (!error)
+                                {
+                                  deliver();
+                                  wait_inbox();
+                                }
+                              }));
+  }
+
+  void
+  shm_transport::receive_udp(udp_leg &leg)
+  {
+    leg.socket.async_receive_from(asio::buffer(leg.buf, sizeof(leg.buf)), leg.sender,
+                                  make_custom_alloc_handler(memory_, [this, &leg](const asio::error_code &error, size_t len)
+                                  {
+                                    if (error == asio::error::operation_aborted)
+                                    {
+                                      return;
+                                    }
+                                    leg.error = error;
+                                    leg.len = len;
+                                    leg.ready = true;
+                                    deliver();
+                                  }));
+  }
+
+  // Hand over received packets (shared memory first) while caller waits for them
+  // Own inbox not empty (same test as dequeue) or UDP datagram kept by a leg
+  bool
+  shm_transport::backlog()
+  {
+    peer &p = segment_->peers[self_];
+
+    const uint64_t pos = p.dequeue_pos.load(std::memory_order_relaxed);
+    const uint64_t idx = pos & (ring_size - 1);
+    if (int64_t(p.cells[idx].seq.load(std::memory_order_acquire) + idx - (pos + 1)) >= 0)
+    {
+      return true;
+    }
+
+    return listen_leg_ && (listen_leg_->ready || send_leg_->ready);
+  }
+
+  void
+  shm_transport::deliver()
+  {
+    while (pending_handler_)
+    {
+      asio::error_code error;
+      size_t len = pending_buf_.size();
+      unsigned from = 0;
+
+      if (dequeue(pending_buf_.data(), len, from))
+      {
+        *pending_sender_ = peer_endpoint(from);
+        if (len > pending_buf_.size())
+        {
+          error = asio::error::message_size;
+          len = pending_buf_.size();
+        }
+      }
+      else if (listen_leg_ && (listen_leg_->ready || send_leg_->ready))
+      {
+        udp_leg &leg = listen_leg_->ready ? *listen_leg_ : *send_leg_;
+        len = asio::buffer_copy(pending_buf_, asio::buffer(leg.buf, leg.len));
+        *pending_sender_ = leg.sender;
+        error = leg.error;
+        leg.ready = false;
+        receive_udp(leg);
+      }
+      else
+      {
+        break;
+      }
+
+      handler h = std::move(pending_handler_);
+      pending_handler_ = nullptr;
+      h(error, len);
+    }
+  }
+
+  void
+  shm_transport::schedule_deliver()
+  {
+    if (!deliver_scheduled_)
+    {
+      deliver_scheduled_ = true;
+      asio::post(io_context_, make_custom_alloc_handler(memory_, [this]()
+                                                        {
+                                                          deliver_scheduled_ = false;
+                                                          deliver();
+                                                        }));
+    }
+  }
+
+  void
+  shm_transport::async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h)
+  {
+    pending_buf_ = buf;
+    pending_sender_ = &sender;
+    pending_handler_ = std::move(h);
+
+    // Packets may be waiting already, deliver them from event loop, not inline
+    schedule_deliver();
+  }
+
+  void
+  shm_transport::cancel_receive()
+  {
+    if (pending_handler_)
+    {
+      asio::post(io_context_,
+                 make_custom_alloc_handler(memory_, [h = std::move(pending_handler_)]()
+                                           { h(asio::error::operation_aborted, 0); }));
+      pending_handler_ = nullptr;
+    }
+  }
+
+  void
+  shm_transport::set_busy_poll(std::chrono::microseconds spin)
+  {
+    if (listen_leg_)
+    {
+      set_busy_poll_option(listen_leg_->socket.native_handle(), spin);
+      set_busy_poll_option(send_leg_->socket.native_handle(), spin);
+    }
+  }
+
+  // Local packets wake asio through eventfd (bridge thread), remote ones
+  // arrive on UDP legs
+  void
+  shm_transport::poll_fds(std::vector<int> &fds)
+  {
+    fds.push_back(event_fd_.native_handle());
+    if (listen_leg_)
+    {
+      fds.push_back(listen_leg_->socket.native_handle());
+      fds.push_back(send_leg_->socket.native_handle());
+    }
+  }
+
+  void
+  shm_transport::async_send_to(asio::const_buffer buf, const endpoint &destination, handler h)
+  {
+    asio::error_code error;
+
+    if (destination == multicast_endpoint_)
+    {
+      // Local peers first, a full inbox drops the packet as a UDP socket would
+      for (unsigned i = 0; i < max_peers; ++i)
+      {
+        if (i != self_)
+        {
+          enqueue(i, buf.data(), buf.size());
+        }
+      }
+
+      if (send_leg_)
+      {
+        send_leg_->socket.async_send_to(buf, destination,
+                                        make_custom_alloc_handler(memory_, std::move(h)));
+        return;
+      }
+    }
+    else if (destination.address().is_unspecified() &&
+             destination.port() >= 1 && destination.port() <= max_peers)
+    {
+      if (!enqueue(destination.port() - 1, buf.data(), buf.size()))
+      {
+        error = asio::error::no_buffer_space;
+      }
+    }
+    else if (send_leg_)
+    {
+      send_leg_->socket.async_send_to(buf, destination,
+                                        make_custom_alloc_handler(memory_, std::move(h)));
+      return;
+    }
+    else
+    {
+      error = asio::error::host_unreachable;
+    }
+
+    size_t len = error ? 0 : buf.size();
+    asio::post(io_context_,
+               make_custom_alloc_handler(memory_, [h = std::move(h), error, len]() { h(error, len); }));
+  }
+} // namespace cbp
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "cbp_base.hpp"
+#include "options.hpp"
+#include "transport.hpp"
+
+namespace cbp
+{
+  // Transport for blocks running on one host (--shm=<name>).
+  // Every process claims a peer slot in a shared memory segment. A slot owns a
+  // lock-free bounded inbox ring, multi-producer (other peers) and single
+  // consumer (owner). Packets keep packet_header framing, multicast is a copy
+  // into every other peer's inbox, unicast goes to one inbox. Local peers are
+  // addressed as 0.0.0.0:<slot+1>, that is never a source of a real datagram.
+  //
+  // Producers bump a futex word of the destination slot; a bridge thread of the
+  // owner waits on it and wakes asio through eventfd.
+  //
+  // Ownership is proven by OFD locks on the segment descriptor, which the
+  // kernel drops when a process dies: the owner write-locks the byte of its
+  // slot, so a slot whose byte can be locked is free or its owner is dead.
+  // Every process read-locks one more byte while attached; the one leaving
+  // last write-locks it and unlinks the segment. Rings are never reset, a
+  // live producer may still write into them: a new owner drains its inbox.
+  //
+  // Unless --shm-only is set, UDP is still used toward remote blocks: multicast
+  // is received on shared port (SO_REUSEADDR, so local blocks do not clash),
+  // everything is sent from own ephemeral port with multicast loop disabled
+  // (local peers already got the packet from shared memory).
+  class shm_transport : public transport
+  {
+  public:
+    shm_transport(asio::io_context &io_context,
+                  const asio::ip::address &listen_address,
+                  const asio::ip::address &multicast_address,
+                  const block_options &options);
+    ~shm_transport() override;
+
+    void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override;
+    void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override;
+    void cancel_receive() override;
+    void set_busy_poll(std::chrono::microseconds spin) override;
+    void poll_fds(std::vector<int> &fds) override;
+    bool backlog() override;
+
+    // Constants
+    static constexpr unsigned max_peers = 16;
+    static constexpr unsigned ring_size = 256; // must be power of 2
+    // Lock byte of attached processes, after bytes of peer slots
+    static constexpr off_t attach_lock = max_peers;
+
+    static endpoint peer_endpoint(unsigned slot)
+    {
+      return endpoint(asio::ip::address_v4::any(), slot + 1);
+    }
+
+  protected:
+    // Cell of Vyukov bounded queue. seq is stored relative to cell index, so
+    // zero-filled memory of a new segment is a valid empty ring.
+    struct cell
+    {
+      std::atomic<uint64_t> seq;
+      uint16_t from;
+      uint16_t len;
+      uint8_t data[max_datagram_len];
+    };
+
+    struct peer
+    {
+      std::atomic<uint32_t> used;     // producers skip absent peers
+      std::atomic<int32_t> pid;       // owner, informational
+      std::atomic<uint32_t> wake;     // futex word, bumped by producers
+      std::atomic<uint32_t> sleeping; // owner's bridge thread waits on futex
+      alignas(64) std::atomic<uint64_t> enqueue_pos;
+      alignas(64) std::atomic<uint64_t> dequeue_pos;
+      alignas(64) cell cells[ring_size];
+    };
+
+    struct segment
+    {
+      peer peers[max_peers];
+    };
+
+    // UDP socket toward remote blocks with its own receive buffer
+    struct udp_leg
+    {
+      explicit udp_leg(asio::io_context &io_context) : socket(io_context) {}
+
+      asio::ip::udp::socket socket;
+      endpoint sender;
+      uint8_t buf[max_datagram_len] = {0};
+      size_t len = {0};
+      asio::error_code error;
+      bool ready = {false};
+    };
+
+    void claim_slot();
+    void drain_inbox();
+    bool enqueue(unsigned slot, const void *data, size_t len);
+    bool dequeue(void *data, size_t &len, unsigned &from);
+
+    void bridge();
+    void wait_inbox();
+    void receive_udp(udp_leg &leg);
+    void deliver();
+    void schedule_deliver();
+
+    asio::io_context &io_context_;
+    std::string shm_name_;
+    int shm_fd_ = {-1}; // kept open, it holds ownership locks
+    segment *segment_ = {nullptr};
+    unsigned self_ = {0};
+
+    asio::posix::stream_descriptor event_fd_;
+    uint64_t event_count_ = {0};
+    std::atomic<bool> stop_ = {false};
+    std::thread bridge_thread_;
+
+    endpoint multicast_endpoint_;
+    std::unique_ptr<udp_leg> listen_leg_; // multicast from remote blocks
+    std::unique_ptr<udp_leg> send_leg_;   // sends and unicast replies
+
+    asio::mutable_buffer pending_buf_;
+    endpoint *pending_sender_ = {nullptr};
+    handler pending_handler_;
+    bool deliver_scheduled_ = {false};
+
+    handler_memory memory_;
+  };
+
+} // namespace cbp
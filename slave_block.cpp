@@ -0,0 +1,78 @@
+#include "client_block.hpp"
+
+#ifdef CBP_COROUTINE_ENGINE
+#include "coro_block.hpp"
+#endif
+
+// Blocking event loop; Ctrl-C ends it, so the block is closed (shm segment
+// unlinked) and the trace is written
+static void
+run(asio::io_context &io_context)
+{
+  asio::signal_set signals(io_context, SIGINT, SIGTERM);
+  signals.async_wait([&](const asio::error_code &, int)
+                     { io_context.stop(); });
+
+  io_context.run();
+
+#ifdef CBP_TRACE
+  cbp::trace::write();
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    if (argc < 3)
+    {
+      std::cerr << "Usage: client_block <listen_address> <multicast_address> [options]\n";
+      std::cerr << "  For IPv4, try:\n";
+      std::cerr << "    client_block 0.0.0.0 239.255.0.1\n";
+      std::cerr << "  For IPv6, try:\n";
+      std::cerr << "    client_block 0::0 ff31::8000:1234\n";
+      cbp::block_options::print_usage(std::cerr);
+      return 1;
+    }
+
+    cbp::block_options options = cbp::block_options::parse(argc, argv, 3);
+
+#ifdef CBP_TRACE
+    if (!options.trace_path.empty())
+    {
+      cbp::trace::start(options.trace_path);
+    }
+#endif
+
+    asio::io_context io_context;
+
+#ifdef CBP_COROUTINE_ENGINE
+    if (options.coro_engine)
+    {
+      cbp::coro_block ib(io_context,
+                         asio::ip::make_address(argv[1]),
+                         asio::ip::make_address(argv[2]),
+                         options,
+                         false);
+      ib.start();
+
+      run(io_context);
+      return 0;
+    }
+#endif
+
+    cbp::client_block ib(io_context,
+                         asio::ip::make_address(argv[1]),
+                         asio::ip::make_address(argv[2]),
+                         options);
+    ib.start();
+
+    run(io_context);
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "state_file.hpp"
+
+namespace cbp
+{
+  static void
+  throw_errno(const char *what)
+  {
+    throw asio::system_error(asio::error_code(errno, asio::error::get_system_category()), what);
+  }
+
+  state_file::state_file(const std::string &path)
+  {
+    fd_ = ::open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+    if (fd_ < 0)
+    {
+      throw_errno("open state file");
+    }
+
+    if (::ftruncate(fd_, sizeof(layout)) < 0)
+    {
+      ::close(fd_);
+      throw_errno("ftruncate state file");
+    }
+
+    void *p = ::mmap(nullptr, sizeof(layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+    {
+      ::close(fd_);
+      throw_errno("mmap state file");
+    }
+
+    data_ = static_cast<layout *>(p);
+
+    restored_ = (data_->magic == magic && data_->version == version && data_->size == sizeof(layout));
+    if (!restored_)
+    {
+      std::memset(data_, 0, sizeof(layout));
+      data_->magic = magic;
+      data_->version = version;
+      data_->size = sizeof(layout);
+      data_->role = to_idx(packet_header::block_mode::slave);
+    }
+  }
+
+  state_file::~state_file()
+  {
+    ::munmap(data_, sizeof(layout));
+    ::close(fd_);
+  }
+
+  void
+  state_file::stored_endpoint::set(const endpoint &ep)
+  {
+    std::memset(addr, 0, sizeof(addr));
+    v6 = ep.address().is_v6();
+    if (v6)
+    {
+      auto b = ep.address().to_v6().to_bytes();
+      std::memcpy(addr, b.data(), b.size());
+    }
+    else
+    {
+      auto b = ep.address().to_v4().to_bytes();
+      std::memcpy(addr, b.data(), b.size());
+    }
+    port = ep.port();
+  }
+
+  state_file::endpoint
+  state_file::stored_endpoint::get() const
+  {
+    if (v6)
+    {
+      asio::ip::address_v6::bytes_type b;
+      std::memcpy(b.data(), addr, b.size());
+      return endpoint(asio::ip::address_v6(b), port);
+    }
+
+    asio::ip::address_v4::bytes_type b;
+    std::memcpy(b.data(), addr, b.size());
+    return endpoint(asio::ip::address_v4(b), port);
+  }
+
+  void
+  state_file::set_master(packet_header::block_mode mode)
+  {
+    data_->role = to_idx(mode);
+    data_->master_id = data_->block_id;
+    data_->master_mode = to_idx(mode);
+    forget_slaves();
+  }
+
+  int
+  state_file::remember_slave(const boost::uuids::uuid &id, const endpoint &ep)
+  {
+    // Linear probing, table is never shrunk by single entries
+    for (unsigned n = 0, i = boost::uuids::hash_value(id) & (max_known_slaves - 1);
+         n < max_known_slaves;
+         ++n, i = (i + 1) & (max_known_slaves - 1))
+    {
+      known_slave &s = data_->slaves[i];
+
+      if (!s.used)
+      {
+        s.id = id;
+        s.ep.set(ep);
+        s.used = 1;
+        ++data_->slave_count;
+        return i;
+      }
+
+      if (s.id == id)
+      {
+        update_slave(i, ep);
+        return i;
+      }
+    }
+    // Full - slave is found by discovery after restart
+    return -1;
+  }
+
+  void
+  state_file::update_slave(unsigned slot, const endpoint &ep)
+  {
+    stored_endpoint e = {};
+    e.set(ep);
+
+    if (!data_->slaves[slot].ep.same(e))
+    {
+      data_->slaves[slot].ep = e;
+    }
+  }
+
+  bool
+  state_file::next_slave(unsigned &pos, endpoint &ep) const
+  {
+    for (; pos < max_known_slaves; ++pos)
+    {
+      if (data_->slaves[pos].used)
+      {
+        ep = data_->slaves[pos++].ep.get();
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void
+  state_file::forget_slaves()
+  {
+    ++generation_;
+    if (data_->slave_count)
+    {
+      std::memset(data_->slaves, 0, sizeof(data_->slaves));
+      data_->slave_count = 0;
+    }
+  }
+
+  void
+  state_file::set_slave(const boost::uuids::uuid &master_id, packet_header::block_mode master_mode,
+                        const endpoint &ep)
+  {
+    data_->role = to_idx(packet_header::block_mode::slave);
+    data_->master_id = master_id;
+    data_->master_mode = to_idx(master_mode);
+    data_->master_ep.set(ep);
+    forget_slaves();
+  }
+
+} // namespace cbp
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "asio.hpp"
+#include "boost/uuid/uuid.hpp"
+
+#include "cbp_base.hpp"
+
+namespace cbp
+{
+  // Block state kept across restarts (--state=<path>) for warm restart.
+  // Small fixed layout file mapped with MAP_SHARED: updates are plain stores
+  // into the page cache, so they survive a crash or kill of the process
+  // (not a power loss) without any write calls on the packet path.
+  //
+  // A block stores its own id, its last role and either the master it
+  // followed (slave) or the slaves that answered it (master). The slave set is
+  // an open addressing table keyed by block id, it stops growing when full.
+  // A known slave answering again from the same endpoint writes nothing, so
+  // steady get_data cycles leave the mapped page clean; its slot is kept by
+  // the master, so they do not search the table either.
+  class state_file
+  {
+  public:
+    using endpoint = asio::ip::udp::endpoint;
+
+    // Constants
+    static constexpr uint32_t magic = 0x43425053; // "CBPS"
+    static constexpr uint32_t version = 1;
+    static constexpr unsigned max_known_slaves = 1024; // must be power of 2
+
+    explicit state_file(const std::string &path);
+    ~state_file();
+
+    state_file(const state_file &) = delete;
+    state_file &operator=(const state_file &) = delete;
+
+    // False if file was just created or had other layout (state is empty)
+    bool restored() const { return restored_; }
+
+    const boost::uuids::uuid &block_id() const { return data_->block_id; }
+    void set_block_id(const boost::uuids::uuid &id) { data_->block_id = id; }
+
+    packet_header::block_mode role() const { return packet_header::block_mode(data_->role); }
+
+    // Became master: slave set starts empty
+    void set_master(packet_header::block_mode mode);
+    // Slot of slave in the set, -1 if the set is full. Valid until
+    // generation() changes, meanwhile the slave is updated by its slot
+    int remember_slave(const boost::uuids::uuid &id, const endpoint &ep);
+    void update_slave(unsigned slot, const endpoint &ep);
+    void forget_slaves();
+    unsigned generation() const { return generation_; }
+
+    unsigned slave_count() const { return data_->slave_count; }
+
+    // Iterate known slaves: start with pos = 0, false when no more
+    bool next_slave(unsigned &pos, endpoint &ep) const;
+
+    // Became slave of master (id, mode) at ep
+    void set_slave(const boost::uuids::uuid &master_id, packet_header::block_mode master_mode,
+                   const endpoint &ep);
+
+    const boost::uuids::uuid &master_id() const { return data_->master_id; }
+    endpoint master_endpoint() const { return data_->master_ep.get(); }
+
+  private:
+    // udp::endpoint in fixed layout, v4 or v6
+    struct stored_endpoint
+    {
+      uint8_t addr[16];
+      uint16_t port;
+      uint8_t v6;
+      uint8_t pad;
+
+      void set(const endpoint &ep);
+      endpoint get() const;
+
+      bool
+      same(const stored_endpoint &other) const
+      {
+        return v6 == other.v6 && port == other.port && !std::memcmp(addr, other.addr, sizeof(addr));
+      }
+    };
+
+    struct known_slave
+    {
+      boost::uuids::uuid id;
+      stored_endpoint ep;
+      uint32_t used;
+    };
+
+    struct layout
+    {
+      uint32_t magic;
+      uint32_t version;
+      uint32_t size;
+      uint16_t role;
+      uint16_t master_mode;
+      boost::uuids::uuid block_id;
+      boost::uuids::uuid master_id;
+      stored_endpoint master_ep;
+      uint32_t slave_count;
+      known_slave slaves[max_known_slaves];
+    };
+
+    int fd_ = {-1};
+    layout *data_ = {nullptr};
+    bool restored_ = {false};
+    unsigned generation_ = {0}; // slave set cleared so many times
+  };
+
+} // namespace cbp
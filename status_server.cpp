@@ -0,0 +1,136 @@
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "boost/uuid/uuid_io.hpp"
+
+#include "status_server.hpp"
+
+namespace cbp
+{
+  // Fixed size, maybe not terminated char array as JSON string
+  template <size_t N, typename C>
+  static void
+  json_string(std::ostream &os, const C (&s)[N])
+  {
+    const char *p = reinterpret_cast<const char *>(s);
+
+    os << '"';
+    for (size_t i = 0; i < N && p[i]; ++i)
+    {
+      const unsigned char c = p[i];
+      if (c == '"' || c == '\\')
+      {
+        os << '\\' << c;
+      }
+      else if (c < 0x20)
+      {
+        os << ' ';
+      }
+      else
+      {
+        os << c;
+      }
+    }
+    os << '"';
+  }
+
+  status_server::status_server(const std::string &path)
+      : path_(path),
+        acceptor_(io_context_)
+  {
+    // Socket left by previous run, never any other file
+    struct stat st;
+    if (::stat(path_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+      ::unlink(path_.c_str());
+    }
+
+    asio::local::stream_protocol::endpoint endpoint(path_);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+
+    accept();
+
+    thread_ = std::thread([this]
+                          { io_context_.run(); });
+  }
+
+  status_server::~status_server()
+  {
+    io_context_.stop();
+    thread_.join();
+    ::unlink(path_.c_str());
+  }
+
+  void
+  status_server::accept()
+  {
+    acceptor_.async_accept([this](const asio::error_code &error, asio::local::stream_protocol::socket socket)
+                           {
+                             if (error == asio::error::operation_aborted)
+                             {
+                               return;
+                             }
+
+                             if (!error)
+                             {
+                               auto s = std::make_shared<asio::local::stream_protocol::socket>(std::move(socket));
+                               auto reply = std::make_shared<std::string>(to_json(snapshot_.load()));
+
+                               asio::async_write(*s, asio::buffer(*reply),
+                                                 [s, reply](const asio::error_code &, size_t) {});
+                             }
+
+                             accept();
+                           });
+  }
+
+  std::string
+  status_server::to_json(const status_snapshot &s)
+  {
+    std::ostringstream os;
+
+    os << "{\"block_id\":\"" << s.block_id << "\""
+       << ",\"state\":\"" << s.state << "\""
+       << ",\"mode\":\"" << packet_header::mode_name(s.mode) << "\""
+       << ",\"updated_ms\":" << s.updated_ms;
+
+    os << ",\"master\":{\"id\":\"" << s.master_id << "\",\"address\":";
+    json_string(os, s.master_address);
+    os << ",\"port\":" << s.master_port << "}";
+
+    os << ",\"cycle\":{\"interval_ms\":" << s.interval_ms
+       << ",\"fleet\":" << s.fleet
+       << ",\"responders\":" << s.responders
+       << ",\"slaves\":[";
+    for (uint32_t i = 0; i < s.listed; ++i)
+    {
+      os << (i ? ",\"" : "\"") << s.slaves[i] << "\"";
+    }
+    os << "]}";
+
+    os << ",\"display\":{\"time\":";
+    json_string(os, s.display.time);
+    os << ",\"text\":";
+    json_string(os, s.display.text);
+    os << ",\"temperature\":";
+    json_string(os, s.display.temperature);
+    os << ",\"brightness\":" << s.display.brightness
+       << ",\"rendered\":" << s.rendered
+       << ",\"skipped\":" << s.render_skipped << "}";
+
+    os << ",\"overload\":{\"deferred\":" << s.overload.deferred
+       << ",\"coalesced\":" << s.overload.coalesced
+       << ",\"dropped\":" << s.overload.dropped
+       << ",\"throttled\":" << s.overload.throttled << "}";
+
+    os << ",\"auth_failed\":" << s.auth_failed << "}\n";
+
+    return os.str();
+  }
+
+} // namespace cbp
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "asio.hpp"
+#include "boost/uuid/uuid.hpp"
+
+#include "cbp_base.hpp"
+#include "deferred_packets.hpp"
+#include "seqlock.hpp"
+
+namespace cbp
+{
+  // What a block tells about itself on --status socket
+  struct status_snapshot
+  {
+    // Constants
+    static constexpr unsigned max_listed = 64;
+
+    int64_t updated_ms = {0}; // system clock
+    const char *state = {""}; // static state name
+    packet_header::block_mode mode = {packet_header::block_mode::master};
+    boost::uuids::uuid block_id = {};
+
+    // Slave: master followed, nil if none
+    boost::uuids::uuid master_id = {};
+    char master_address[48] = {0};
+    uint16_t master_port = {0};
+
+    // Master: last finished get_data cycle, first max_listed responders
+    uint32_t interval_ms = {0};
+    double fleet = {0};
+    uint32_t responders = {0};
+    uint32_t listed = {0};
+    boost::uuids::uuid slaves[max_listed] = {};
+
+    // Last display_data sent (master) or shown (slave), brightness in host order
+    display_data display;
+
+    // Slave: frames drawn, and replaced before drawn (--render)
+    uint64_t rendered = {0};
+    uint64_t render_skipped = {0};
+
+    // Packets shed or delayed under overload
+    overload_counters overload;
+
+    // Packets dropped for missing or wrong tag (--auth)
+    uint64_t auth_failed = {0};
+  };
+
+  // Read-only status of a block on a Unix stream socket (--status=<path>).
+  // Every connection gets one JSON object of the latest snapshot and is
+  // closed, e.g. 'nc -U <path>'. Served by own thread and io_context: the
+  // protocol thread only stores a snapshot into a seqlock on state changes
+  // and cycle ends, so any rate of polls never delays packet handling.
+  class status_server
+  {
+  public:
+    explicit status_server(const std::string &path);
+    ~status_server();
+
+    status_server(const status_server &) = delete;
+    status_server &operator=(const status_server &) = delete;
+
+    // Protocol thread, never blocks
+    void publish(const status_snapshot &s) { snapshot_.store(s); }
+
+  private:
+    void accept();
+    static std::string to_json(const status_snapshot &s);
+
+    std::string path_;
+    seqlock<status_snapshot> snapshot_;
+    asio::io_context io_context_;
+    asio::local::stream_protocol::acceptor acceptor_;
+    std::thread thread_;
+  };
+
+} // namespace cbp
@@ -0,0 +1,238 @@
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "boost/uuid/uuid_generators.hpp"
+
+#include "block_store.hpp"
+#include "client_block.hpp"
+
+// get_data cycles of one master against N simulated slaves (default 100k):
+// block_store (struct of arrays) versus array of objects as big as
+// client_block. Master has given every slave a session (session_assign), so
+// both sides answer with session_header as client_block does. Every response
+// is serialized and parsed by the master as it would be on the wire.
+
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+  // client_block data members of get_data path in declaration order, with
+  // buffers of control_block
+  struct object_fields
+  {
+    std::vector<std::vector<std::function<void()>>> dispatcher;
+    uint8_t recv_buf[cbp::max_datagram_len] = {0};
+    uint8_t send_buf[cbp::max_packet_len] = {0};
+    int t_accum = {0};
+    int b_accum = {0};
+    int count_accum = {0};
+    int set_data_cycles = {0};
+    cbp::display_data data_for_slaves;
+    int state = {2};
+    int attempts = {0};
+    cbp::packet_header::block_mode mode = {cbp::packet_header::block_mode::tmp_master};
+    bool oldest = {true};
+    cbp::sensor_data sensors;
+    boost::uuids::uuid master_block_id = {boost::uuids::nil_uuid()};
+    uint64_t master_key = {0};
+    cbp::packet_header::block_mode master_mode = {cbp::packet_header::block_mode::master};
+    uint16_t session = {0};
+    uint16_t session_epoch = {0};
+    boost::uuids::uuid block_id;
+    std::uniform_int_distribution<int16_t> random_temperature{-45, 45};
+    std::uniform_int_distribution<uint16_t> random_brightness{350, 550};
+  };
+
+  // Rest of client_block (transport and timer pointers, templates, status,
+  // queues) left untouched, so blocks are as far apart as real ones
+  struct object_block : object_fields
+  {
+    uint8_t rest[sizeof(cbp::client_block) - sizeof(object_fields)];
+  };
+
+  // Master side: parse get_data_rsp as control_block::handle_get_data_response
+  struct master_stats
+  {
+    long t_accum = {0};
+    long b_accum = {0};
+    size_t count = {0};
+
+    void
+    receive(uint8_t *buf, size_t len)
+    {
+      size_t header_len = sizeof(cbp::packet_header);
+      if (cbp::session_header::is_session(buf, len))
+      {
+        if (!cbp::session_header::is_packet_valid(buf, len))
+        {
+          return;
+        }
+        header_len = sizeof(cbp::session_header);
+      }
+      else if (!cbp::packet_header::is_packet_valid(buf, len) ||
+               cbp::packet_header::op_from_netbuf(buf) != cbp::packet_header::packet_type::get_data_rsp)
+      {
+        return;
+      }
+
+      cbp::sensor_data sd;
+      sd.from_payload(buf + header_len);
+      t_accum += sd.temperature;
+      b_accum += sd.brightness;
+      ++count;
+    }
+  };
+
+  void
+  report(const char *name, clock_type::time_point start, const master_stats &m)
+  {
+    const double s = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    std::cout << name
+              << ": responses=" << m.count
+              << ", " << double(m.count) / s / 1e6 << " M responses/s"
+              << ", " << s * 1e9 / double(m.count) << " ns/block"
+              << std::endl;
+  }
+
+  void
+  run_store(size_t n, int cycles, const boost::uuids::uuid &master_id)
+  {
+    cbp::block_store store(n);
+    boost::uuids::random_generator gen;
+    for (size_t i = 0; i < n; ++i)
+    {
+      store.add(gen());
+    }
+
+    uint8_t req[cbp::max_packet_len];
+    uint8_t rsp[cbp::max_packet_len];
+    master_stats m;
+
+    auto sink = [&](size_t i, cbp::packet_header::packet_type pt)
+    {
+      m.receive(rsp, store.reply_to_netbuf(i, pt, rsp));
+    };
+
+    cbp::packet_header::to_netbuf(req, cbp::packet_header::packet_type::slave_needed_req,
+                                  cbp::packet_header::block_mode::master, master_id);
+    store.handle_packet(req, sizeof(cbp::packet_header), clock_type::now(), sink);
+
+    cbp::packet_header::to_netbuf(req, cbp::packet_header::packet_type::session_assign,
+                                  cbp::packet_header::block_mode::master, master_id);
+    for (size_t i = 0; i < n; ++i)
+    {
+      const cbp::session_grant grant = {uint16_t(i % 0xffff + 1), 1};
+      grant.to_netbuf(req);
+      store.handle_packet(i, req, sizeof(cbp::packet_header) + sizeof(grant), clock_type::now(), sink);
+    }
+
+    cbp::packet_header::to_netbuf(req, cbp::packet_header::packet_type::get_data_req,
+                                  cbp::packet_header::block_mode::master, master_id);
+
+    const auto start = clock_type::now();
+    for (int c = 0; c < cycles; ++c)
+    {
+      store.handle_packet(req, sizeof(cbp::packet_header), clock_type::now(), sink);
+    }
+    report("block_store ", start, m);
+
+    store.print_memory(std::cout);
+  }
+
+  void
+  run_objects(size_t n, int cycles, const boost::uuids::uuid &master_id)
+  {
+    // rest of blocks is not initialized, as their memory is never touched
+    std::unique_ptr<object_block[]> blocks(new object_block[n]);
+    boost::uuids::random_generator gen;
+    for (size_t i = 0; i < n; ++i)
+    {
+      blocks[i].block_id = gen();
+    }
+
+    std::minstd_rand rd;
+    uint8_t req[cbp::max_packet_len];
+    master_stats m;
+
+    // slave_needed_req: everybody follows the master, then gets a session
+    for (size_t i = 0; i < n; ++i)
+    {
+      object_block &b = blocks[i];
+      b.state = 3;
+      b.master_block_id = master_id;
+      b.master_key = cbp::packet_header::key_of(master_id);
+      b.session = uint16_t(i % 0xffff + 1);
+      b.session_epoch = 1;
+    }
+
+    cbp::packet_header::to_netbuf(req, cbp::packet_header::packet_type::get_data_req,
+                                  cbp::packet_header::block_mode::master, master_id);
+
+    const auto start = clock_type::now();
+    for (int c = 0; c < cycles; ++c)
+    {
+      for (size_t i = 0; i < n; ++i)
+      {
+        object_block &b = blocks[i];
+
+        // Per-block copy of the datagram, as each client_block receives its own
+        std::memcpy(b.recv_buf, req, sizeof(cbp::packet_header));
+
+        if (b.state == 3 && cbp::packet_header::key_from_netbuf(b.recv_buf) == b.master_key &&
+            cbp::poll_selector::polls(b.recv_buf, sizeof(cbp::packet_header), b.block_id))
+        {
+          b.sensors.temperature = b.random_temperature(rd);
+          b.sensors.brightness = b.random_brightness(rd);
+
+          cbp::session_header::to_netbuf(b.send_buf, cbp::packet_header::packet_type::get_data_rsp,
+                                         b.mode, b.session, b.session_epoch);
+          b.sensors.to_payload(b.send_buf + sizeof(cbp::session_header));
+          m.receive(b.send_buf, sizeof(cbp::session_header) + sizeof(cbp::sensor_data));
+        }
+      }
+    }
+    report("object_block", start, m);
+
+    std::cout << "object_block: " << sizeof(object_block) << " B/block, "
+              << sizeof(object_fields) << " B touched" << std::endl;
+  }
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 3)
+  {
+    std::cerr << "Usage: store_bench [blocks] [cycles]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    store_bench 100000 100\n";
+    return 1;
+  }
+
+  const size_t n = (argc >= 2) ? std::strtoul(argv[1], nullptr, 10) : 100000;
+  const int cycles = (argc == 3) ? std::atoi(argv[2]) : 100;
+  const boost::uuids::uuid master_id = boost::uuids::random_generator()();
+
+  // Memory of one real client_block: object, dispatcher_ 7x4 std::function
+  // holding heap allocated std::bind(&member, this), transport
+  const size_t functions = to_idx(cbp::packet_header::packet_type::number) * 4;
+  const size_t dispatcher = to_idx(cbp::packet_header::packet_type::number) * sizeof(std::vector<std::function<void()>>) +
+                            functions * (sizeof(std::function<void()>) +
+                                         sizeof(std::bind(&cbp::block_store::size, (cbp::block_store *)nullptr)));
+
+  std::cout << "client_block: object=" << sizeof(cbp::client_block)
+            << " B, dispatcher_ heap>=" << dispatcher
+            << " B, transport=" << sizeof(cbp::udp_transport)
+            << " B, total>=" << sizeof(cbp::client_block) + dispatcher + sizeof(cbp::udp_transport)
+            << " B/block" << std::endl;
+
+  run_store(n, cycles, master_id);
+  run_objects(n, cycles, master_id);
+
+  return 0;
+}
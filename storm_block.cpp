@@ -0,0 +1,166 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <string>
+#include "asio.hpp"
+#include "boost/uuid/uuid.hpp"
+#include "boost/uuid/uuid_generators.hpp"
+
+#include "cbp_base.hpp"
+#include "options.hpp"
+#include "packet_auth.hpp"
+#include "transport.hpp"
+
+// Synthetic load generator for transport benchmarks. Registers itself as a
+// slave of the master and then floods the group with get_data_rsp packets,
+// as a slave does: with session_header once the master gave a session
+// (session_assign), each packet signed with the next counter under --auth.
+// Master's handling rate is seen in its "Average calculated" output (N=).
+int main(int argc, char *argv[])
+{
+  try
+  {
+    if (argc < 2 || argc > 4)
+    {
+      std::cerr << "Usage: storm_block <multicast_address> [packets_per_second] [--auth=<key_file>]\n";
+      std::cerr << "  For IPv4, try:\n";
+      std::cerr << "    storm_block 239.255.0.1 200000\n";
+      std::cerr << "  0 or no rate means as fast as possible\n";
+      return 1;
+    }
+
+    const bool has_rate = (argc >= 3 && argv[2][0] != '-');
+    const long rate = has_rate ? std::stol(argv[2]) : 0;
+    const cbp::block_options options = cbp::block_options::parse(argc, argv, has_rate ? 3 : 2);
+
+    asio::io_context io_context;
+    asio::ip::udp::endpoint multicast_endpoint(asio::ip::make_address(argv[1]),
+                                               cbp::multicast_port);
+    asio::ip::udp::socket socket(io_context, multicast_endpoint.protocol());
+    socket.non_blocking(true);
+
+    using cbp::packet_header;
+    uint8_t buf[cbp::max_datagram_len] = {0};
+    uint8_t in[cbp::max_datagram_len] = {0};
+    const boost::uuids::uuid id = boost::uuids::random_generator()();
+
+    // --auth: counter and tag after every packet, as auth_transport does
+    std::unique_ptr<cbp::packet_auth> auth;
+    uint64_t counter = 0;
+    if (options.auth)
+    {
+      auth = std::make_unique<cbp::packet_auth>(options.auth_key);
+      counter = cbp::auth_transport::first_counter();
+    }
+
+    auto send = [&](size_t len)
+    {
+      if (auth)
+      {
+        len = auth->sign(buf, len, ++counter);
+      }
+      socket.send_to(asio::buffer(buf, len), multicast_endpoint);
+    };
+
+    // Master in waiting_for_slave state goes to master state on first slave
+    packet_header::to_netbuf(buf, packet_header::packet_type::i_am_slave_rsp,
+                             packet_header::block_mode::slave, id);
+    send(sizeof(packet_header));
+
+    cbp::sensor_data data;
+    data.temperature = 20;
+    data.brightness = 450;
+
+    // get_data_rsp with packet_header is answered by session_assign, one
+    // more every 100 ms for a second
+    cbp::session_grant grant;
+    for (int attempt = 0; attempt < 10 && !grant.session; ++attempt)
+    {
+      packet_header::to_netbuf(buf, packet_header::packet_type::get_data_rsp,
+                               packet_header::block_mode::slave, id);
+      data.to_netbuf(buf);
+      send(sizeof(packet_header) + sizeof(cbp::sensor_data));
+
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+      while (!grant.session && std::chrono::steady_clock::now() < deadline)
+      {
+        asio::ip::udp::endpoint from;
+        asio::error_code error;
+        size_t len = socket.receive_from(asio::buffer(in, sizeof(in)), from, 0, error);
+        if (error)
+        {
+          continue;
+        }
+
+        if (auth)
+        {
+          if (len < sizeof(packet_header) + cbp::packet_auth::trailer_len)
+          {
+            continue;
+          }
+
+          len -= cbp::packet_auth::trailer_len;
+          if (!auth->verify(in, len, cbp::packet_auth::tag_from_netbuf(in + len + cbp::packet_auth::counter_len)))
+          {
+            continue;
+          }
+        }
+
+        if (packet_header::is_packet_valid(in, len) &&
+            packet_header::op_from_netbuf(in) == packet_header::packet_type::session_assign)
+        {
+          grant.from_netbuf(in);
+        }
+      }
+    }
+
+    // Flood blocks on full socket buffer
+    socket.non_blocking(false);
+
+    size_t len = sizeof(packet_header) + sizeof(cbp::sensor_data);
+    if (grant.session)
+    {
+      std::cout << "Session=" << grant.session << ", epoch=" << grant.epoch << std::endl;
+
+      cbp::session_header::to_netbuf(buf, packet_header::packet_type::get_data_rsp,
+                                     packet_header::block_mode::slave, grant.session, grant.epoch);
+      data.to_payload(buf + sizeof(cbp::session_header));
+      len = sizeof(cbp::session_header) + sizeof(cbp::sensor_data);
+    }
+    else
+    {
+      std::cout << "No session from master, get_data_rsp goes with packet_header" << std::endl;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto report = start;
+    long sent = 0;
+    long sent_reported = 0;
+
+    for (;;)
+    {
+      send(len);
+      ++sent;
+
+      auto now = std::chrono::steady_clock::now();
+      if (now - report >= std::chrono::seconds(1))
+      {
+        std::cout << "Sent get_data_rsp: " << (sent - sent_reported) << " pkt/s" << std::endl;
+        sent_reported = sent;
+        report = now;
+      }
+
+      // Simple pacing: stay behind the configured rate
+      while (rate && sent > rate * std::chrono::duration<double>(now - start).count())
+      {
+        now = std::chrono::steady_clock::now();
+      }
+    }
+  }
+  catch (std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include "timer_wheel.hpp"
+
+namespace cbp
+{
+  asio::io_context::id timer_wheel::id;
+
+  timer_wheel::timer_wheel(asio::io_context &io_context)
+      : asio::io_context::service(io_context),
+        origin_(clock::now())
+  {
+  }
+
+  timer_wheel::~timer_wheel()
+  {
+    shutdown();
+  }
+
+  // Drop all armed timers, their handlers are never called
+  void
+  timer_wheel::shutdown()
+  {
+    for (auto &slot : wheel_)
+    {
+      while (slot.linked())
+      {
+        static_cast<timer *>(slot.next)->handler_ = nullptr;
+        slot.next->unlink();
+      }
+    }
+
+    while (due_.linked())
+    {
+      static_cast<timer *>(due_.next)->handler_ = nullptr;
+      due_.next->unlink();
+    }
+
+    armed_ = 0;
+  }
+
+  void
+  timer_wheel::arm(timer &t, clock::time_point expiry)
+  {
+    if (t.linked())
+    {
+      t.unlink();
+      --armed_;
+    }
+
+    if (!driver_running_)
+    {
+      // Wheel was idle, bring it to present time before hashing
+      current_tick_ = std::max(current_tick_, elapsed_tick(clock::now()));
+    }
+
+    // Expired or due in current tick - fire on the next one
+    t.expiry_tick_ = std::max(tick_of(expiry), current_tick_ + 1);
+    wheel_[t.expiry_tick_ & (slots - 1)].push_back(t);
+    ++armed_;
+
+    schedule_tick();
+  }
+
+  bool
+  timer_wheel::cancel(timer &t)
+  {
+    if (!t.linked())
+    {
+      return false;
+    }
+
+    t.unlink();
+    --armed_;
+    return true;
+  }
+
+  void
+  timer_wheel::schedule_tick()
+  {
+    if (driver_running_)
+    {
+      return;
+    }
+
+    driver_running_ = true;
+    if (clock::is_virtual())
+    {
+      return;
+    }
+
+    if (!driver_)
+    {
+      driver_.emplace(get_io_context());
+    }
+
+    driver_->expires_at(origin_ + (current_tick_ + 1) * tick);
+    driver_->async_wait(make_custom_alloc_handler(memory_, [this](const asio::error_code &e)
+                                                 { handle_tick(e); }));
+  }
+
+  bool
+  timer_wheel::next_tick(clock::time_point &tp) const
+  {
+    if (!armed_)
+    {
+      return false;
+    }
+
+    // First slot of this turn with a timer due in it, else the turn ends
+    uint64_t next = current_tick_ + slots;
+    for (uint64_t tk = current_tick_ + 1; tk < current_tick_ + slots && next == current_tick_ + slots; ++tk)
+    {
+      const link &slot = wheel_[tk & (slots - 1)];
+
+      for (const link *l = slot.next; l != &slot; l = l->next)
+      {
+        if (static_cast<const timer *>(l)->expiry_tick_ == tk)
+        {
+          next = tk;
+          break;
+        }
+      }
+    }
+
+    tp = origin_ + next * tick;
+    return true;
+  }
+
+  void
+  timer_wheel::handle_tick(const asio::error_code &e)
+  {
+    driver_running_ = false;
+
+    if (e == asio::error::operation_aborted)
+    {
+      return;
+    }
+
+    // Visit every slot passed since last tick (once if the loop lagged a whole turn)
+    const uint64_t now_tick = elapsed_tick(clock::now());
+    const uint64_t last = std::min(now_tick, current_tick_ + slots);
+
+    for (uint64_t tk = current_tick_ + 1; tk <= last; ++tk)
+    {
+      link &slot = wheel_[tk & (slots - 1)];
+
+      for (link *l = slot.next; l != &slot;)
+      {
+        link *next = l->next;
+
+        // Timers of later wheel turns stay in the slot
+        if (static_cast<timer *>(l)->expiry_tick_ <= now_tick)
+        {
+          l->unlink();
+          due_.push_back(*l);
+        }
+
+        l = next;
+      }
+    }
+
+    current_tick_ = now_tick;
+
+    // Handlers may re-arm or cancel any timer, including ones still in due_
+    while (due_.linked())
+    {
+      timer &t = *static_cast<timer *>(due_.next);
+      t.unlink();
+      --armed_;
+
+      CBP_TRACE_EVENT(timer_fire, t.trace_track_, t.trace_name_, 0);
+
+      handler h = std::move(t.handler_);
+      h(asio::error_code());
+    }
+
+    if (armed_)
+    {
+      schedule_tick();
+    }
+  }
+
+} // namespace cbp
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+#include "asio.hpp"
+
+#include "block_clock.hpp"
+#include "handler_memory.hpp"
+#include "trace.hpp"
+
+namespace cbp
+{
+  // Hashed timing wheel, one per io_context (asio service).
+  // Timers are intrusive list nodes hashed by expiry tick into a slot, so arm,
+  // re-arm and cancel are O(1) unlink/link, nothing is posted or allocated.
+  // The whole wheel is driven by one asio::steady_timer which ticks only while
+  // some timer is armed. Resolution is one tick, timers never fire early.
+  // Under virtual block_clock the driver is not created (nor the reactor it
+  // would start polling on every io_context pass): the simulation moves time
+  // to next_tick() and calls run_tick().
+  // Not thread safe, io_context must be run from one thread.
+  class timer_wheel : public asio::io_context::service
+  {
+  public:
+    using clock = block_clock;
+    using handler = std::function<void(const asio::error_code &)>;
+
+    static asio::io_context::id id;
+
+    // Constants
+    static constexpr clock::duration tick = std::chrono::milliseconds(10);
+    static constexpr unsigned slots = 1024; // must be power of 2
+
+    class timer;
+
+    explicit timer_wheel(asio::io_context &io_context);
+    ~timer_wheel() override;
+
+    size_t armed() const { return armed_; }
+
+    // Virtual clock: time of the next tick firing a timer (empty ticks are
+    // skipped), false if none is armed
+    bool next_tick(clock::time_point &tp) const;
+    // Fire timers due by now
+    void run_tick() { handle_tick(asio::error_code()); }
+
+  private:
+    // Circular doubly linked list node, slot heads are sentinels
+    struct link
+    {
+      link *prev = {this};
+      link *next = {this};
+
+      bool linked() const { return next != this; }
+
+      void
+      unlink()
+      {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = this;
+      }
+
+      void
+      push_back(link &l)
+      {
+        l.prev = prev;
+        l.next = this;
+        prev->next = &l;
+        prev = &l;
+      }
+    };
+
+    void shutdown() override;
+
+    void arm(timer &t, clock::time_point expiry);
+    bool cancel(timer &t);
+    void schedule_tick();
+    void handle_tick(const asio::error_code &e);
+
+    // Expiry: rounded up, time_point::max() must not overflow
+    uint64_t tick_of(clock::time_point tp) const
+    {
+      const clock::duration d = std::max(tp - origin_, clock::duration::zero());
+      return uint64_t(d / tick) + (d % tick != clock::duration::zero());
+    }
+
+    // Now: rounded down, only ticks fully elapsed fire their timers
+    uint64_t elapsed_tick(clock::time_point tp) const
+    {
+      return uint64_t(std::max(tp - origin_, clock::duration::zero()) / tick);
+    }
+
+    std::optional<asio::steady_timer> driver_; // on first real tick
+    bool driver_running_ = {false};
+    clock::time_point origin_;
+    uint64_t current_tick_ = {0};
+    size_t armed_ = {0};
+
+    link wheel_[slots];
+    link due_; // expired in current tick, not yet fired
+    handler_memory memory_;
+  };
+
+  // Single deadline owned by a block. Re-arming replaces the previous deadline
+  // and handler, cancel() just drops it - the handler is not called.
+  class timer_wheel::timer : private timer_wheel::link
+  {
+  public:
+    explicit timer(asio::io_context &io_context)
+        : wheel_(asio::use_service<timer_wheel>(io_context)),
+          executor_(io_context.get_executor())
+    {
+    }
+
+    timer(const timer &) = delete;
+    timer &operator=(const timer &) = delete;
+
+    ~timer() { cancel(); }
+
+    void expires_at(clock::time_point expiry, handler h)
+    {
+      if (armed())
+      {
+        CBP_TRACE_EVENT(timer_cancel, trace_track_, trace_name_, 0);
+      }
+      CBP_TRACE_EVENT(timer_set, trace_track_, trace_name_,
+                      std::clamp<int64_t>(std::chrono::ceil<std::chrono::milliseconds>(expiry - clock::now()).count(),
+                                          0, UINT32_MAX));
+
+      handler_ = std::move(h);
+      wheel_.arm(*this, expiry);
+    }
+
+    void expires_after(clock::duration d, handler h) { expires_at(clock::now() + d, std::move(h)); }
+
+    // Returns false if the timer was not armed (fired or cancelled before)
+    bool cancel()
+    {
+      if (!wheel_.cancel(*this))
+      {
+        return false;
+      }
+
+      CBP_TRACE_EVENT(timer_cancel, trace_track_, trace_name_, 0);
+      return true;
+    }
+
+    bool armed() const { return linked(); }
+
+    asio::io_context::executor_type get_executor() const { return executor_; }
+
+#ifdef CBP_TRACE
+    // Events of this timer go to row of track (--trace)
+    void
+    trace_as(const void *track, const char *name)
+    {
+      trace_track_ = track;
+      trace_name_ = name;
+    }
+#endif
+
+  private:
+    friend class timer_wheel;
+
+    timer_wheel &wheel_;
+    asio::io_context::executor_type executor_;
+    uint64_t expiry_tick_ = {0};
+    handler handler_;
+#ifdef CBP_TRACE
+    const void *trace_track_ = {nullptr};
+    const char *trace_name_ = {"timer"};
+#endif
+  };
+
+} // namespace cbp
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+#include "block_clock.hpp"
+
+namespace cbp
+{
+  // Rate limit of discovery multicasts (--discovery): up to burst packets at
+  // once, then rate per second. Refilled lazily by caller's clock
+  class token_bucket
+  {
+  public:
+    using clock = block_clock;
+
+    token_bucket(double rate, double burst) : rate_(rate), burst_(burst), tokens_(burst) {}
+
+    // One token if there is one
+    bool take(clock::time_point now)
+    {
+      tokens_ = std::min(burst_, tokens_ + rate_ * std::chrono::duration<double>(now - last_).count());
+      last_ = now;
+
+      if (tokens_ < 1)
+      {
+        return false;
+      }
+
+      tokens_ -= 1;
+      return true;
+    }
+
+  private:
+    double rate_;
+    double burst_;
+    double tokens_;
+    clock::time_point last_ = {clock::now()};
+  };
+
+} // namespace cbp
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+#include "cbp_base.hpp"
+#include "trace.hpp"
+#include "transport.hpp"
+
+namespace cbp::trace
+{
+  std::atomic<bool> enabled = {false};
+
+  namespace
+  {
+    struct buffer
+    {
+      std::vector<event> events;
+      uint64_t dropped = {0};
+    };
+
+    // Buffers outlive their threads, write() may run after they exit
+    std::mutex mutex;
+    std::vector<std::unique_ptr<buffer>> buffers;
+    std::map<const void *, std::string> track_names;
+    std::string path;
+
+    thread_local buffer *local = nullptr;
+
+    const char *
+    packet_name(asio::const_buffer buf)
+    {
+      if (buf.size() < sizeof(uint16_t))
+      {
+        return "runt";
+      }
+
+      // Short session header carries the same type under session_flag
+      uint16_t op;
+      std::memcpy(&op, buf.data(), sizeof(op));
+      return packet_header::type_name(packet_header::packet_type(ntohs(op) & ~session_header::session_flag));
+    }
+
+    // Counts every packet through the inner transport
+    class traced_transport : public transport
+    {
+    public:
+      traced_transport(std::unique_ptr<transport> inner, const void *track)
+          : inner_(std::move(inner)), track_(track)
+      {
+      }
+
+      void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override
+      {
+        inner_->async_receive_from(buf, sender, [this, buf, h = std::move(h)](const asio::error_code &error, size_t n)
+                                   {
+                                     if (!error)
+                                     {
+                                       record(kind::receive, track_, packet_name(asio::buffer(buf, n)), n);
+                                     }
+                                     h(error, n);
+                                   });
+      }
+
+      void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override
+      {
+        record(kind::send, track_, packet_name(buf), buf.size());
+        inner_->async_send_to(buf, destination, std::move(h));
+      }
+
+      void cancel_receive() override { inner_->cancel_receive(); }
+      void set_busy_poll(std::chrono::microseconds spin) override { inner_->set_busy_poll(spin); }
+      void poll_fds(std::vector<int> &fds) override { inner_->poll_fds(fds); }
+      bool receive_time(std::chrono::system_clock::time_point &tp) override { return inner_->receive_time(tp); }
+      bool backlog() override { return inner_->backlog(); }
+
+    private:
+      std::unique_ptr<transport> inner_;
+      const void *track_;
+    };
+
+    // Chrome trace time: microseconds
+    void
+    print_ts(std::ostream &os, int64_t ns)
+    {
+      os << ns / 1000 << '.' << char('0' + ns / 100 % 10) << char('0' + ns / 10 % 10) << char('0' + ns % 10);
+    }
+  } // namespace
+
+  void
+  append(const event &e)
+  {
+    if (!local)
+    {
+      auto b = std::make_unique<buffer>();
+      b->events.reserve(events_per_thread);
+
+      std::lock_guard lock(mutex);
+      buffers.push_back(std::move(b));
+      local = buffers.back().get();
+    }
+
+    if (local->events.size() == events_per_thread)
+    {
+      ++local->dropped;
+      return;
+    }
+
+    local->events.push_back(e);
+  }
+
+  void
+  start(const std::string &p)
+  {
+    std::lock_guard lock(mutex);
+    path = p;
+    enabled = true;
+  }
+
+  void
+  name_track(const void *track, const std::string &name)
+  {
+    std::lock_guard lock(mutex);
+    track_names[track] = name;
+  }
+
+  std::unique_ptr<transport>
+  traced(std::unique_ptr<transport> t, const void *track)
+  {
+    return std::make_unique<traced_transport>(std::move(t), track);
+  }
+
+  void
+  write()
+  {
+    if (!enabled.exchange(false))
+    {
+      return;
+    }
+
+    std::lock_guard lock(mutex);
+
+    std::vector<event> events;
+    uint64_t dropped = 0;
+    for (auto &b : buffers)
+    {
+      events.insert(events.end(), b->events.begin(), b->events.end());
+      dropped += b->dropped;
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [](const event &a, const event &b)
+                     { return a.ts_ns < b.ts_ns; });
+
+    std::ofstream os(path);
+    if (!os)
+    {
+      std::cerr << "Can't write trace " << path << std::endl;
+      return;
+    }
+
+    const int pid = getpid();
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    os << "{\"ph\":\"M\",\"pid\":" << pid << ",\"name\":\"process_name\",\"args\":{\"name\":\"cbp " << pid << "\"}}";
+
+    // Row of every track, in order of first event
+    std::map<const void *, unsigned> tids;
+    for (const event &e : events)
+    {
+      if (tids.emplace(e.track, tids.size() + 1).second)
+      {
+        const auto name = track_names.find(e.track);
+        os << ",\n{\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tids.size()
+           << ",\"name\":\"thread_name\",\"args\":{\"name\":\""
+           << (name != track_names.end() ? name->second : "track " + std::to_string(tids.size())) << "\"}}";
+      }
+    }
+
+    // State lasts until the next one of its track, the last until trace end
+    std::map<const void *, const event *> states;
+    auto close_state = [&](const event &s, int64_t end_ns)
+    {
+      os << ",\n{\"ph\":\"X\",\"cat\":\"state\",\"pid\":" << pid << ",\"tid\":" << tids[s.track]
+         << ",\"name\":\"" << s.name << "\",\"ts\":";
+      print_ts(os, s.ts_ns);
+      os << ",\"dur\":";
+      print_ts(os, end_ns - s.ts_ns);
+      os << "}";
+    };
+
+    for (const event &e : events)
+    {
+      if (e.k == kind::state)
+      {
+        if (auto s = states.find(e.track); s != states.end())
+        {
+          close_state(*s->second, e.ts_ns);
+        }
+        states[e.track] = &e;
+        continue;
+      }
+
+      static const char *kinds[] = {"state", "send", "receive", "set", "fire", "cancel"};
+      const bool packet = (e.k == kind::send || e.k == kind::receive);
+
+      os << ",\n{\"ph\":\"i\",\"s\":\"t\",\"cat\":\"" << (packet ? "packet" : "timer")
+         << "\",\"pid\":" << pid << ",\"tid\":" << tids[e.track]
+         << ",\"name\":\"" << e.name << ' ' << kinds[to_idx(e.k)] << "\",\"ts\":";
+      print_ts(os, e.ts_ns);
+
+      if (packet)
+      {
+        os << ",\"args\":{\"bytes\":" << e.arg << "}";
+      }
+      else if (e.k == kind::timer_set)
+      {
+        os << ",\"args\":{\"ms\":" << e.arg << "}";
+      }
+      os << "}";
+    }
+
+    const int64_t end_ns = events.empty() ? 0 : events.back().ts_ns;
+    for (const auto &[track, s] : states)
+    {
+      close_state(*s, end_ns);
+    }
+
+    os << "\n]}\n";
+
+    std::cerr << "Trace " << path << ": " << events.size() << " events, " << dropped << " dropped" << std::endl;
+  }
+
+} // namespace cbp::trace
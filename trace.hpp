@@ -0,0 +1,87 @@
+#pragma once
+
+// Protocol event tracing, built with 'make TRACE=1' and enabled by
+// --trace=<file>. Hooks are CBP_TRACE_EVENT macros, which expand to nothing
+// in a normal build, so tracing costs nothing there.
+//
+// Every thread appends fixed size binary events to its own buffer without
+// locking. trace::write merges the buffers into Chrome trace JSON (open in
+// ui.perfetto.dev or chrome://tracing). Events belong to a track, any
+// object (a block), shown as its own row: state spans, packets sent and
+// received by type, timers armed, fired and cancelled.
+
+#ifdef CBP_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace cbp
+{
+  class transport;
+}
+
+namespace cbp::trace
+{
+  enum class kind : uint8_t
+  {
+    state,        // name - new state
+    send,         // name - packet type, arg - bytes
+    receive,      // name - packet type, arg - bytes
+    timer_set,    // name - timer, arg - ms to expiry
+    timer_fire,   // name - timer
+    timer_cancel, // name - timer
+  };
+
+  struct event
+  {
+    int64_t ts_ns;
+    const void *track;
+    const char *name; // static string, only the pointer is kept
+    uint32_t arg;
+    kind k;
+  };
+
+  // Set by start(), before blocks run
+  extern std::atomic<bool> enabled;
+
+  // Buffer of calling thread, registered on first use
+  void append(const event &e);
+
+  inline void
+  record(kind k, const void *track, const char *name, uint32_t arg)
+  {
+    if (enabled.load(std::memory_order_relaxed))
+    {
+      const auto now = std::chrono::steady_clock::now().time_since_epoch();
+      append({std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), track, name, arg, k});
+    }
+  }
+
+  // Start recording, write() saves to path
+  void start(const std::string &path);
+
+  // Row title of track
+  void name_track(const void *track, const std::string &name);
+
+  // Merge buffers of all threads into the file, other threads must not
+  // record meanwhile. Nothing is done unless started
+  void write();
+
+  // Records every packet sent and received through t under track
+  std::unique_ptr<transport> traced(std::unique_ptr<transport> t, const void *track);
+
+  // Constants
+  static constexpr size_t events_per_thread = 1 << 20; // more are counted as dropped
+
+} // namespace cbp::trace
+
+#define CBP_TRACE_EVENT(k, track, name, arg) ::cbp::trace::record(::cbp::trace::kind::k, track, name, arg)
+
+#else
+
+#define CBP_TRACE_EVENT(k, track, name, arg) ((void)0)
+
+#endif
@@ -0,0 +1,177 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+
+#include "transport.hpp"
+#include "shm_transport.hpp"
+#include "timer_wheel.hpp"
+
+#ifdef CBP_USE_IO_URING
+#include "uring_transport.hpp"
+#endif
+
+namespace cbp
+{
+  udp_transport::udp_transport(asio::io_context &io_context,
+                               const asio::ip::address &listen_address,
+                               const asio::ip::address &multicast_address)
+      : socket_(io_context)
+  {
+    // Create the socket so that multiple may be bound to the same address.
+    asio::ip::udp::endpoint listen_endpoint(listen_address, multicast_port);
+    socket_.open(listen_endpoint.protocol());
+    socket_.bind(listen_endpoint);
+
+    // Join the multicast group.
+    socket_.set_option(asio::ip::multicast::join_group(multicast_address));
+  }
+
+  // SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN, then
+  // only the poll loop spins
+  void
+  set_busy_poll_option(int fd, std::chrono::microseconds spin)
+  {
+    int usec = int(spin.count());
+    if (::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+    {
+      std::cout << "Warning! SO_BUSY_POLL is not set: " << std::strerror(errno) << std::endl;
+    }
+  }
+
+  void
+  udp_transport::set_busy_poll(std::chrono::microseconds spin)
+  {
+    set_busy_poll_option(socket_.native_handle(), spin);
+  }
+
+  // Stamp of the last datagram read from the socket (enabled by first call)
+  bool
+  udp_transport::receive_time(std::chrono::system_clock::time_point &tp)
+  {
+    timespec ts;
+    if (::ioctl(socket_.native_handle(), SIOCGSTAMPNS, &ts) < 0)
+    {
+      return false;
+    }
+
+    tp = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+    return true;
+  }
+
+  lossy_transport::lossy_transport(asio::io_context &io_context, std::unique_ptr<transport> inner,
+                                   double loss, std::chrono::microseconds delay,
+                                   std::chrono::microseconds jitter, unsigned seed)
+      : io_context_(io_context),
+        inner_(std::move(inner)),
+        loss_(loss),
+        delay_(delay),
+        jitter_(0, jitter.count()),
+        random_(seed)
+  {
+  }
+
+  struct lossy_transport::delayed
+  {
+    explicit delayed(asio::io_context &io_context) : timer(io_context) {}
+
+    timer_wheel::timer timer;
+    std::vector<uint8_t> data;
+    endpoint destination;
+  };
+
+  lossy_transport::~lossy_transport() = default;
+
+  void
+  lossy_transport::async_send_to(asio::const_buffer buf, const endpoint &destination, handler h)
+  {
+    if (loss_(random_))
+    {
+      asio::post(io_context_, [h = std::move(h), n = buf.size()]
+                 { h(asio::error_code(), n); });
+      return;
+    }
+
+    const auto delay = delay_ + std::chrono::microseconds(jitter_(random_));
+    if (delay.count() == 0)
+    {
+      inner_->async_send_to(buf, destination, std::move(h));
+      return;
+    }
+
+    if (block_clock::is_virtual())
+    {
+      auto d = delayed_.emplace(delayed_.end(), io_context_);
+      d->data.assign(static_cast<const uint8_t *>(buf.data()), static_cast<const uint8_t *>(buf.data()) + buf.size());
+      d->destination = destination;
+
+      d->timer.expires_after(delay, [this, d](const asio::error_code &)
+                             {
+                               inner_->async_send_to(asio::buffer(d->data), d->destination,
+                                                     [this, d](const asio::error_code &, size_t)
+                                                     { delayed_.erase(d); });
+                             });
+
+      asio::post(io_context_, [h = std::move(h), n = buf.size()]
+                 { h(asio::error_code(), n); });
+      return;
+    }
+
+    // Own copy of datagram and timer live until the delayed send completes
+    auto data = std::make_shared<std::vector<uint8_t>>(static_cast<const uint8_t *>(buf.data()),
+                                                       static_cast<const uint8_t *>(buf.data()) + buf.size());
+    auto timer = std::make_shared<asio::steady_timer>(io_context_, delay);
+
+    timer->async_wait([this, data, timer, destination](const asio::error_code &error)
+                      {
+                        if (!error)
+                        {
+                          inner_->async_send_to(asio::buffer(*data), destination,
+                                                [data](const asio::error_code &, size_t) {});
+                        }
+                      });
+
+    asio::post(io_context_, [h = std::move(h), n = buf.size()]
+               { h(asio::error_code(), n); });
+  }
+
+  std::unique_ptr<transport>
+  transport::create(asio::io_context &io_context,
+                    const asio::ip::address &listen_address,
+                    const asio::ip::address &multicast_address,
+                    const block_options &options)
+  {
+    std::unique_ptr<transport> t;
+
+    if (!options.shm_name.empty())
+    {
+      t = std::make_unique<shm_transport>(io_context, listen_address, multicast_address, options);
+    }
+    else
+    {
+#ifdef CBP_USE_IO_URING
+      t = std::make_unique<uring_transport>(io_context, listen_address, multicast_address);
+#else
+      t = std::make_unique<udp_transport>(io_context, listen_address, multicast_address);
+#endif
+    }
+
+    return impair(io_context, std::move(t), options);
+  }
+
+  std::unique_ptr<transport>
+  transport::impair(asio::io_context &io_context, std::unique_ptr<transport> t, const block_options &options,
+                    unsigned seed)
+  {
+    if (options.loss > 0 || options.delay.count() || options.jitter.count())
+    {
+      return std::make_unique<lossy_transport>(io_context, std::move(t),
+                                               options.loss, options.delay, options.jitter, seed);
+    }
+
+    return t;
+  }
+} // namespace cbp
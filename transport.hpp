@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "asio.hpp"
+
+#include "handler_memory.hpp"
+#include "options.hpp"
+
+namespace cbp
+{
+  const short multicast_port = 30001;
+
+  // Datagram transport used by control_block for all CBP traffic.
+  // Semantics follow asio::ip::udp::socket: one outstanding receive at a time,
+  // buffers must stay valid until the handler is called.
+  class transport
+  {
+  public:
+    using endpoint = asio::ip::udp::endpoint;
+    // Blocks pass lambdas capturing only 'this', which std::function keeps
+    // inline, so passing a handler does not allocate
+    using handler = std::function<void(const asio::error_code &, size_t)>;
+
+    virtual ~transport() = default;
+
+    virtual void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) = 0;
+    virtual void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) = 0;
+
+    // Complete outstanding receive (if any) with asio::error::operation_aborted
+    virtual void cancel_receive() = 0;
+
+    // Busy polling (--busy-poll): SO_BUSY_POLL on own sockets and descriptors
+    // that become readable when a receive may complete, for an external poll()
+    virtual void set_busy_poll(std::chrono::microseconds spin) = 0;
+    virtual void poll_fds(std::vector<int> &fds) = 0;
+
+    // Kernel receive time of the datagram of the last completed receive,
+    // false if transport can't tell
+    virtual bool receive_time(std::chrono::system_clock::time_point &) { return false; }
+
+    // More datagrams wait to be received (a receive would complete at once),
+    // false if transport can't tell
+    virtual bool backlog() { return false; }
+
+    // Create transport selected by options (shared memory) or at build time
+    // (asio reactor or io_uring)
+    static std::unique_ptr<transport> create(asio::io_context &io_context,
+                                             const asio::ip::address &listen_address,
+                                             const asio::ip::address &multicast_address,
+                                             const block_options &options);
+
+    // t itself, or wrapped into lossy_transport if options ask for it.
+    // Losses are random unless seed is given (fleet_sim, reproducible runs)
+    static std::unique_ptr<transport> impair(asio::io_context &io_context, std::unique_ptr<transport> t,
+                                             const block_options &options, unsigned seed = std::random_device()());
+  };
+
+  // Shared by transports, warns if option can't be set
+  void set_busy_poll_option(int fd, std::chrono::microseconds spin);
+
+  // Default transport: asio reactor (epoll readiness + recvfrom/sendto)
+  class udp_transport : public transport
+  {
+  public:
+    udp_transport(asio::io_context &io_context,
+                  const asio::ip::address &listen_address,
+                  const asio::ip::address &multicast_address);
+
+    void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override
+    {
+      socket_.async_receive_from(buf, sender,
+                                 asio::bind_cancellation_slot(receive_cancel_.slot(),
+                                                              make_custom_alloc_handler(memory_, std::move(h))));
+    }
+
+    void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override
+    {
+      socket_.async_send_to(buf, destination, make_custom_alloc_handler(memory_, std::move(h)));
+    }
+
+    // Per-operation cancellation, sends in flight are not affected
+    void cancel_receive() override
+    {
+      receive_cancel_.emit(asio::cancellation_type::terminal);
+    }
+
+    void set_busy_poll(std::chrono::microseconds spin) override;
+    void poll_fds(std::vector<int> &fds) override { fds.push_back(socket_.native_handle()); }
+    bool receive_time(std::chrono::system_clock::time_point &tp) override;
+
+    bool backlog() override
+    {
+      asio::error_code error;
+      return socket_.available(error) > 0;
+    }
+
+  protected:
+    asio::ip::udp::socket socket_;
+    handler_memory memory_;
+    asio::cancellation_signal receive_cancel_;
+  };
+
+  // Impaired network on top of any transport (--loss): sent datagrams are
+  // dropped with given probability and the rest delayed by delay plus
+  // uniform jitter (so they may be reordered). Sends complete at once, as
+  // UDP ones do, the datagram is copied if it is delayed. Under virtual
+  // block_clock (fleet_sim) delays are timer_wheel timers, rounded up to a tick.
+  class lossy_transport : public transport
+  {
+  public:
+    lossy_transport(asio::io_context &io_context, std::unique_ptr<transport> inner,
+                    double loss, std::chrono::microseconds delay, std::chrono::microseconds jitter,
+                    unsigned seed);
+    ~lossy_transport() override;
+
+    void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override
+    {
+      inner_->async_receive_from(buf, sender, std::move(h));
+    }
+
+    void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override;
+
+    void cancel_receive() override { inner_->cancel_receive(); }
+    void set_busy_poll(std::chrono::microseconds spin) override { inner_->set_busy_poll(spin); }
+    void poll_fds(std::vector<int> &fds) override { inner_->poll_fds(fds); }
+    bool receive_time(std::chrono::system_clock::time_point &tp) override { return inner_->receive_time(tp); }
+    bool backlog() override { return inner_->backlog(); }
+
+  private:
+    struct delayed;
+
+    asio::io_context &io_context_;
+    std::unique_ptr<transport> inner_;
+    std::list<delayed> delayed_; // virtual clock only, until sent
+    std::bernoulli_distribution loss_;
+    std::chrono::microseconds delay_;
+    std::uniform_int_distribution<long> jitter_;
+    std::minstd_rand random_;
+  };
+
+} // namespace cbp
@@ -0,0 +1,308 @@
+#include <cerrno>
+#include <sys/eventfd.h>
+
+#include "uring_transport.hpp"
+
+namespace cbp
+{
+  static void
+  throw_on_error(int ret, const char *what)
+  {
+    if (ret < 0)
+    {
+      throw asio::system_error(asio::error_code(-ret, asio::error::get_system_category()), what);
+    }
+  }
+
+  uring_transport::uring_transport(asio::io_context &io_context,
+                                   const asio::ip::address &listen_address,
+                                   const asio::ip::address &multicast_address)
+      : udp_transport(io_context, listen_address, multicast_address),
+        recv_mem_(recv_buffers * recv_buffer_len),
+        event_fd_(io_context),
+        send_slots_(send_slots)
+  {
+    throw_on_error(io_uring_queue_init(ring_entries, &ring_, 0), "io_uring_queue_init");
+
+    // Provided buffer ring for multishot receive
+    int ret = 0;
+    buf_ring_ = io_uring_setup_buf_ring(&ring_, recv_buffers, recv_group_id, 0, &ret);
+    if (!buf_ring_)
+    {
+      io_uring_queue_exit(&ring_);
+      throw_on_error(ret, "io_uring_setup_buf_ring");
+    }
+
+    for (unsigned bid = 0; bid < recv_buffers; ++bid)
+    {
+      io_uring_buf_ring_add(buf_ring_, recv_mem_.data() + bid * recv_buffer_len, recv_buffer_len,
+                            bid, io_uring_buf_ring_mask(recv_buffers), bid);
+    }
+    io_uring_buf_ring_advance(buf_ring_, recv_buffers);
+
+    // Template for multishot recvmsg: room for peer address, no control data
+    recv_msg_.msg_namelen = sizeof(sockaddr_in6);
+
+    // Completions are signalled through eventfd read by asio
+    int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    throw_on_error(efd < 0 ? -errno : 0, "eventfd");
+    event_fd_.assign(efd);
+    throw_on_error(io_uring_register_eventfd(&ring_, efd), "io_uring_register_eventfd");
+
+    free_slots_.reserve(send_slots);
+    for (unsigned i = send_slots; i > 0; --i)
+    {
+      free_slots_.push_back(i - 1);
+    }
+
+    arm_receive();
+    io_uring_submit(&ring_);
+    wait_completions();
+  }
+
+  uring_transport::~uring_transport()
+  {
+    io_uring_free_buf_ring(&ring_, buf_ring_, recv_buffers, recv_group_id);
+    io_uring_queue_exit(&ring_);
+  }
+
+  io_uring_sqe *
+  uring_transport::get_sqe()
+  {
+    io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+    if (!sqe)
+    {
+      // SQ is full - submit what is queued and retry
+      io_uring_submit(&ring_);
+      sqe = io_uring_get_sqe(&ring_);
+    }
+    return sqe;
+  }
+
+  void
+  uring_transport::arm_receive()
+  {
+    io_uring_sqe *sqe = get_sqe();
+    io_uring_prep_recvmsg_multishot(sqe, socket_.native_handle(), &recv_msg_, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = recv_group_id;
+    io_uring_sqe_set_data64(sqe, recv_tag);
+    schedule_flush();
+  }
+
+  // All SQEs queued within one event loop turn go to the kernel with one syscall
+  void
+  uring_transport::schedule_flush()
+  {
+    if (!flush_scheduled_)
+    {
+      flush_scheduled_ = true;
+      asio::post(socket_.get_executor(),
+                 make_custom_alloc_handler(memory_, [this]()
+                                           {
+                                             flush_scheduled_ = false;
+                                             io_uring_submit(&ring_);
+                                           }));
+    }
+  }
+
+  void
+  uring_transport::wait_completions()
+  {
+    event_fd_.async_read_some(asio::buffer(&event_count_, sizeof(event_count_)),
+                              make_custom_alloc_handler(memory_, [this](const asio::error_code &error, size_t)
+                              {
+                                if (!error)
+                                {
+                                  reap();
+                                  wait_completions();
+                                }
+                              }));
+  }
+
+  void
+  uring_transport::reap()
+  {
+    bool rearm = false;
+    unsigned head = 0;
+    unsigned count = 0;
+    io_uring_cqe *cqe = nullptr;
+
+    io_uring_for_each_cqe(&ring_, head, cqe)
+    {
+      ++count;
+
+      if (cqe->user_data == recv_tag)
+      {
+        // Multishot terminates without F_MORE, arm it again. On -ENOBUFS all
+        // buffers wait in backlog: armed again when one is recycled, not
+        // right away to fail the same way
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+        {
+          if (cqe->res == -ENOBUFS)
+          {
+            rearm_on_recycle_ = true;
+          }
+          else
+          {
+            rearm = true;
+          }
+        }
+
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+          uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+          if (cqe->res < 0)
+          {
+            recycle_buffer(bid);
+          }
+          else
+          {
+            backlog_[backlog_tail_++ % recv_buffers] = {bid, cqe->res};
+          }
+        }
+        continue;
+      }
+
+      // Send completion
+      send_slot &s = send_slots_[cqe->user_data];
+      handler h = std::move(s.h);
+      s.h = nullptr;
+      free_slots_.push_back(cqe->user_data);
+
+      if (cqe->res < 0)
+      {
+        h(asio::error_code(-cqe->res, asio::error::get_system_category()), 0);
+      }
+      else
+      {
+        h(asio::error_code(), cqe->res);
+      }
+    }
+
+    io_uring_cq_advance(&ring_, count);
+
+    deliver_backlog();
+
+    if (rearm)
+    {
+      arm_receive();
+    }
+  }
+
+  void
+  uring_transport::deliver_backlog()
+  {
+    while (pending_handler_ && backlog_head_ != backlog_tail_)
+    {
+      received r = backlog_[backlog_head_++ % recv_buffers];
+
+      uint8_t *buf = recv_mem_.data() + r.bid * recv_buffer_len;
+      io_uring_recvmsg_out *out = io_uring_recvmsg_validate(buf, r.len, &recv_msg_);
+
+      asio::error_code error;
+      size_t len = 0;
+
+      if (!out)
+      {
+        error = asio::error::invalid_argument;
+      }
+      else
+      {
+        len = asio::buffer_copy(pending_buf_,
+                                asio::buffer(io_uring_recvmsg_payload(out, &recv_msg_),
+                                             io_uring_recvmsg_payload_length(out, r.len, &recv_msg_)));
+
+        std::memcpy(pending_sender_->data(), io_uring_recvmsg_name(out),
+                    std::min<size_t>(out->namelen, sizeof(sockaddr_in6)));
+        pending_sender_->resize(std::min<size_t>(out->namelen, sizeof(sockaddr_in6)));
+
+        if (out->flags & MSG_TRUNC)
+        {
+          error = asio::error::message_size;
+        }
+      }
+
+      recycle_buffer(r.bid);
+
+      // Handler normally issues next async_receive_from right away
+      handler h = std::move(pending_handler_);
+      pending_handler_ = nullptr;
+      h(error, len);
+    }
+  }
+
+  void
+  uring_transport::recycle_buffer(uint16_t bid)
+  {
+    io_uring_buf_ring_add(buf_ring_, recv_mem_.data() + bid * recv_buffer_len, recv_buffer_len,
+                          bid, io_uring_buf_ring_mask(recv_buffers), 0);
+    io_uring_buf_ring_advance(buf_ring_, 1);
+
+    if (rearm_on_recycle_)
+    {
+      rearm_on_recycle_ = false;
+      arm_receive();
+    }
+  }
+
+  void
+  uring_transport::async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h)
+  {
+    pending_buf_ = buf;
+    pending_sender_ = &sender;
+    pending_handler_ = std::move(h);
+
+    // Datagrams already received - deliver them from event loop, not inline
+    if (backlog_head_ != backlog_tail_)
+    {
+      asio::post(socket_.get_executor(),
+                 make_custom_alloc_handler(memory_, [this]() { deliver_backlog(); }));
+    }
+  }
+
+  void
+  uring_transport::cancel_receive()
+  {
+    // Multishot recvmsg keeps running, only the caller's request is aborted
+    if (pending_handler_)
+    {
+      asio::post(socket_.get_executor(),
+                 make_custom_alloc_handler(memory_, [h = std::move(pending_handler_)]()
+                                           { h(asio::error::operation_aborted, 0); }));
+      pending_handler_ = nullptr;
+    }
+  }
+
+  void
+  uring_transport::async_send_to(asio::const_buffer buf, const endpoint &destination, handler h)
+  {
+    if (free_slots_.empty() || buf.size() > max_datagram_len)
+    {
+      asio::post(socket_.get_executor(),
+                 make_custom_alloc_handler(memory_, [h = std::move(h)]()
+                                           { h(asio::error::no_buffer_space, 0); }));
+      return;
+    }
+
+    unsigned idx = free_slots_.back();
+    free_slots_.pop_back();
+
+    // Datagram is copied, so caller's buffer may be reused immediately
+    send_slot &s = send_slots_[idx];
+    std::memcpy(s.data, buf.data(), buf.size());
+    std::memcpy(&s.name, destination.data(), destination.size());
+    s.iov = {s.data, buf.size()};
+    s.msg = {};
+    s.msg.msg_name = &s.name;
+    s.msg.msg_namelen = destination.size();
+    s.msg.msg_iov = &s.iov;
+    s.msg.msg_iovlen = 1;
+    s.h = std::move(h);
+
+    io_uring_sqe *sqe = get_sqe();
+    io_uring_prep_sendmsg(sqe, socket_.native_handle(), &s.msg, 0);
+    io_uring_sqe_set_data64(sqe, idx);
+    schedule_flush();
+  }
+} // namespace cbp
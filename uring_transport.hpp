@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "liburing.h"
+
+#include "cbp_base.hpp"
+#include "transport.hpp"
+
+namespace cbp
+{
+  // io_uring transport (build with IO_URING=1).
+  // Socket setup is inherited from udp_transport, then the socket is driven
+  // through io_uring only: a single multishot recvmsg fills a provided buffer
+  // ring, sends are queued as sendmsg SQEs and submitted in one batch per event
+  // loop turn. Completions are signalled to asio through a registered eventfd.
+  class uring_transport : public udp_transport
+  {
+  public:
+    uring_transport(asio::io_context &io_context,
+                    const asio::ip::address &listen_address,
+                    const asio::ip::address &multicast_address);
+    ~uring_transport() override;
+
+    void async_receive_from(asio::mutable_buffer buf, endpoint &sender, handler h) override;
+    void async_send_to(asio::const_buffer buf, const endpoint &destination, handler h) override;
+    void cancel_receive() override;
+    void poll_fds(std::vector<int> &fds) override { fds.push_back(event_fd_.native_handle()); }
+    // Datagrams are batched by multishot recvmsg, socket stamp is not per packet
+    bool receive_time(std::chrono::system_clock::time_point &) override { return false; }
+    // Reaped but not consumed datagrams only, socket is not asked
+    bool backlog() override { return backlog_head_ != backlog_tail_; }
+
+  protected:
+    // Constants
+    static constexpr unsigned ring_entries = 256;
+    static constexpr unsigned recv_buffers = 64; // must be power of 2
+    static constexpr unsigned send_slots = 64;
+    static constexpr int recv_group_id = 0;
+    static constexpr size_t recv_buffer_len = sizeof(io_uring_recvmsg_out) +
+                                              sizeof(sockaddr_in6) + max_datagram_len;
+    // user_data of multishot recvmsg, send slots use their index
+    static constexpr uint64_t recv_tag = ~uint64_t(0);
+
+    struct send_slot
+    {
+      msghdr msg;
+      iovec iov;
+      sockaddr_in6 name;
+      uint8_t data[max_datagram_len];
+      handler h;
+    };
+
+    // Received datagram not yet consumed by async_receive_from
+    struct received
+    {
+      uint16_t bid;
+      int len;
+    };
+
+    void arm_receive();
+    void wait_completions();
+    void reap();
+    void deliver_backlog();
+    void recycle_buffer(uint16_t bid);
+    void schedule_flush();
+    io_uring_sqe *get_sqe();
+
+    io_uring ring_;
+    io_uring_buf_ring *buf_ring_ = {nullptr};
+    std::vector<uint8_t> recv_mem_;
+    msghdr recv_msg_ = {};
+    bool rearm_on_recycle_ = {false}; // receive ended with -ENOBUFS
+
+    asio::posix::stream_descriptor event_fd_;
+    uint64_t event_count_ = {0};
+
+    // Backlog can't exceed number of provided buffers
+    received backlog_[recv_buffers];
+    unsigned backlog_head_ = {0};
+    unsigned backlog_tail_ = {0};
+
+    asio::mutable_buffer pending_buf_;
+    endpoint *pending_sender_ = {nullptr};
+    handler pending_handler_;
+
+    std::vector<send_slot> send_slots_;
+    std::vector<unsigned> free_slots_;
+    bool flush_scheduled_ = {false};
+  };
+
+} // namespace cbp
@@ -0,0 +1,196 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "asio.hpp"
+
+#include "timer_wheel.hpp"
+
+// Arm, re-arm, cancel and expire N deadlines (default 1M) with timer_wheel and
+// with one asio::steady_timer per deadline, the way blocks used to do it.
+// Re-arm models a slave restarting tmout_no_request_from_master per get_data_req.
+// Fails if timer_wheel fires any timer before its deadline.
+
+using clock_type = std::chrono::steady_clock;
+
+namespace
+{
+  double
+  ns_per_op(clock_type::time_point start, size_t ops)
+  {
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / double(ops);
+  }
+
+  std::vector<clock_type::duration>
+  make_timeouts(size_t n)
+  {
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int> ms(200, 700);
+
+    std::vector<clock_type::duration> v(n);
+    for (auto &d : v)
+    {
+      d = std::chrono::milliseconds(ms(gen));
+    }
+    return v;
+  }
+
+  struct result
+  {
+    double arm;
+    double rearm;
+    double cancel;
+    size_t fired;
+    size_t early; // fired before deadline, must be none
+    clock_type::duration max_late;
+  };
+
+  void
+  print(const char *name, const result &r)
+  {
+    std::cout << name
+              << ": arm=" << r.arm << "ns"
+              << ", rearm=" << r.rearm << "ns"
+              << ", cancel=" << r.cancel << "ns"
+              << ", fired=" << r.fired
+              << ", early=" << r.early
+              << ", max_late=" << std::chrono::duration_cast<std::chrono::milliseconds>(r.max_late).count() << "ms"
+              << std::endl;
+  }
+
+  result
+  run_wheel(const std::vector<clock_type::duration> &tmouts)
+  {
+    const size_t n = tmouts.size();
+    asio::io_context io_context;
+    std::vector<std::unique_ptr<cbp::timer_wheel::timer>> timers(n);
+    struct context
+    {
+      std::vector<clock_type::time_point> deadlines;
+      result r;
+    } c = {std::vector<clock_type::time_point>(n), {}};
+    auto *ctx = &c;
+    auto &deadlines = c.deadlines;
+    auto &r = c.r;
+
+    for (auto &t : timers)
+    {
+      t = std::make_unique<cbp::timer_wheel::timer>(io_context);
+    }
+
+    auto arm_all = [&]
+    {
+      for (size_t i = 0; i < n; ++i)
+      {
+        deadlines[i] = clock_type::now() + tmouts[i];
+        // Two words of capture, fits into std::function without allocation
+        timers[i]->expires_at(deadlines[i], [ctx, i](const asio::error_code &)
+                              {
+                                ++ctx->r.fired;
+                                ctx->r.early += (clock_type::now() < ctx->deadlines[i]);
+                                ctx->r.max_late = std::max(ctx->r.max_late,
+                                                           clock_type::now() - ctx->deadlines[i]);
+                              });
+      }
+    };
+
+    auto start = clock_type::now();
+    arm_all();
+    r.arm = ns_per_op(start, n);
+
+    start = clock_type::now();
+    arm_all();
+    r.rearm = ns_per_op(start, n);
+
+    start = clock_type::now();
+    for (size_t i = 0; i < n; i += 10)
+    {
+      timers[i]->cancel();
+    }
+    r.cancel = ns_per_op(start, (n + 9) / 10);
+
+    io_context.run();
+    return r;
+  }
+
+  result
+  run_steady_timer(const std::vector<clock_type::duration> &tmouts)
+  {
+    const size_t n = tmouts.size();
+    asio::io_context io_context;
+    std::vector<std::unique_ptr<asio::steady_timer>> timers(n);
+    result r = {};
+
+    for (auto &t : timers)
+    {
+      t = std::make_unique<asio::steady_timer>(io_context);
+    }
+
+    auto arm_all = [&]
+    {
+      for (size_t i = 0; i < n; ++i)
+      {
+        timers[i]->expires_after(tmouts[i]);
+        timers[i]->async_wait([&, i](const asio::error_code &e)
+                              {
+                                if (e != asio::error::operation_aborted)
+                                {
+                                  ++r.fired;
+                                  r.early += (clock_type::now() < timers[i]->expiry());
+                                  r.max_late = std::max(r.max_late, clock_type::now() - timers[i]->expiry());
+                                }
+                              });
+      }
+    };
+
+    auto start = clock_type::now();
+    arm_all();
+    r.arm = ns_per_op(start, n);
+
+    // expires_after() cancels the pending wait, aborted handler is posted
+    start = clock_type::now();
+    arm_all();
+    r.rearm = ns_per_op(start, n);
+
+    start = clock_type::now();
+    for (size_t i = 0; i < n; i += 10)
+    {
+      timers[i]->cancel();
+    }
+    r.cancel = ns_per_op(start, (n + 9) / 10);
+
+    io_context.run();
+    return r;
+  }
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+  if (argc > 2)
+  {
+    std::cerr << "Usage: wheel_bench [timers]\n";
+    std::cerr << "  Example:\n";
+    std::cerr << "    wheel_bench 1000000\n";
+    return 1;
+  }
+
+  const size_t n = (argc == 2) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const auto tmouts = make_timeouts(n);
+
+  std::cout << "timers=" << n << ", cancelled=" << (n + 9) / 10 << std::endl;
+  const result wheel = run_wheel(tmouts);
+  print("timer_wheel ", wheel);
+  print("steady_timer", run_steady_timer(tmouts));
+
+  if (wheel.early)
+  {
+    std::cerr << "timer_wheel fired " << wheel.early << " timers before their deadline" << std::endl;
+    return 1;
+  }
+
+  return 0;
+}